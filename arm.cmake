@@ -7,6 +7,7 @@ set(CMAKE_C_COMPILER "/usr/local/bin/${TOOLCHAIN_PREFIX}gcc")
 set(CMAKE_SYSROOT "/usr/local/${TOOLCHAIN_PREFIX_PREFIX}")
 set(CMAKE_SIZE "${TOOLCHAIN_PREFIX}size")
 set(CMAKE_OBJCOPY "${TOOLCHAIN_PREFIX}objcopy")
+set(CMAKE_NM "${TOOLCHAIN_PREFIX}nm")
 
 # Search for programs in the build host directories
 set(CMAKE_FIND_ROOT_PATH_MODE_PROGRAM NEVER)
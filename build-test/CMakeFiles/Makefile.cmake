@@ -0,0 +1,61 @@
+# CMAKE generated file: DO NOT EDIT!
+# Generated by "Unix Makefiles" Generator, CMake Version 3.25
+
+# The generator used is:
+set(CMAKE_DEPENDS_GENERATOR "Unix Makefiles")
+
+# The top level Makefile was generated from the following files:
+set(CMAKE_MAKEFILE_DEPENDS
+  "CMakeCache.txt"
+  "CMakeFiles/3.25.1/CMakeCCompiler.cmake"
+  "CMakeFiles/3.25.1/CMakeSystem.cmake"
+  "/root/repo/test/CMakeLists.txt"
+  "/usr/share/cmake-3.25/Modules/CMakeCInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeCommonLanguageInclude.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeGenericSystem.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeInitializeConfigs.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeLanguageInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeSystemSpecificInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeSystemSpecificInitialize.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/CMakeCommonCompilerMacros.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/GNU-C.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/GNU.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux-GNU-C.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux-GNU.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/UnixPaths.cmake"
+  )
+
+# The corresponding makefile is:
+set(CMAKE_MAKEFILE_OUTPUTS
+  "Makefile"
+  "CMakeFiles/cmake.check_cache"
+  )
+
+# Byproducts of CMake generate step:
+set(CMAKE_MAKEFILE_PRODUCTS
+  "CMakeFiles/CMakeDirectoryInformation.cmake"
+  )
+
+# Dependency information for all targets:
+set(CMAKE_DEPEND_INFO_FILES
+  "CMakeFiles/crc_test_bit.dir/DependInfo.cmake"
+  "CMakeFiles/crc_test_nibble.dir/DependInfo.cmake"
+  "CMakeFiles/crc_test_byte.dir/DependInfo.cmake"
+  "CMakeFiles/sdk_stubs.dir/DependInfo.cmake"
+  "CMakeFiles/serial_link_test.dir/DependInfo.cmake"
+  "CMakeFiles/serial_link_bench_swar0.dir/DependInfo.cmake"
+  "CMakeFiles/serial_link_bench_swar1.dir/DependInfo.cmake"
+  "CMakeFiles/sdk_sim.dir/DependInfo.cmake"
+  "CMakeFiles/serial_link_boot_test.dir/DependInfo.cmake"
+  "CMakeFiles/uart_task_credit_test.dir/DependInfo.cmake"
+  "CMakeFiles/uart_task_tx_test_stream0.dir/DependInfo.cmake"
+  "CMakeFiles/uart_task_tx_test_stream1.dir/DependInfo.cmake"
+  "CMakeFiles/uart_task_ping_test.dir/DependInfo.cmake"
+  "CMakeFiles/uart_task_link_test_stream0.dir/DependInfo.cmake"
+  "CMakeFiles/uart_task_link_test_stream1.dir/DependInfo.cmake"
+  "CMakeFiles/uart_task_lanes_test_stream0.dir/DependInfo.cmake"
+  "CMakeFiles/uart_task_lanes_test_stream1.dir/DependInfo.cmake"
+  "CMakeFiles/uart_task_dma_test.dir/DependInfo.cmake"
+  "CMakeFiles/uart_task_oom_test.dir/DependInfo.cmake"
+  )
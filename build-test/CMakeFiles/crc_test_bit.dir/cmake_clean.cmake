@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/crc_test_bit.dir/crc_test.c.o"
+  "CMakeFiles/crc_test_bit.dir/crc_test.c.o.d"
+  "CMakeFiles/crc_test_bit.dir/root/repo/src/crc.c.o"
+  "CMakeFiles/crc_test_bit.dir/root/repo/src/crc.c.o.d"
+  "crc_test_bit"
+  "crc_test_bit.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/crc_test_bit.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
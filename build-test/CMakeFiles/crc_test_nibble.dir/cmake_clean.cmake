@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/crc_test_nibble.dir/crc_test.c.o"
+  "CMakeFiles/crc_test_nibble.dir/crc_test.c.o.d"
+  "CMakeFiles/crc_test_nibble.dir/root/repo/src/crc.c.o"
+  "CMakeFiles/crc_test_nibble.dir/root/repo/src/crc.c.o.d"
+  "crc_test_nibble"
+  "crc_test_nibble.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/crc_test_nibble.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/sdk_sim.dir/sdk_sim.c.o"
+  "CMakeFiles/sdk_sim.dir/sdk_sim.c.o.d"
+  "libsdk_sim.a"
+  "libsdk_sim.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/sdk_sim.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/sdk_stubs.dir/uart_stub.c.o"
+  "CMakeFiles/sdk_stubs.dir/uart_stub.c.o.d"
+  "libsdk_stubs.a"
+  "libsdk_stubs.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/sdk_stubs.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
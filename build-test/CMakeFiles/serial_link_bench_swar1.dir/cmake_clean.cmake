@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/serial_link_bench_swar1.dir/root/repo/src/crc.c.o"
+  "CMakeFiles/serial_link_bench_swar1.dir/root/repo/src/crc.c.o.d"
+  "CMakeFiles/serial_link_bench_swar1.dir/root/repo/src/serial_link.c.o"
+  "CMakeFiles/serial_link_bench_swar1.dir/root/repo/src/serial_link.c.o.d"
+  "CMakeFiles/serial_link_bench_swar1.dir/serial_link_bench.c.o"
+  "CMakeFiles/serial_link_bench_swar1.dir/serial_link_bench.c.o.d"
+  "serial_link_bench_swar1"
+  "serial_link_bench_swar1.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/serial_link_bench_swar1.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/serial_link_boot_test.dir/root/repo/src/crc.c.o"
+  "CMakeFiles/serial_link_boot_test.dir/root/repo/src/crc.c.o.d"
+  "CMakeFiles/serial_link_boot_test.dir/root/repo/src/serial_link.c.o"
+  "CMakeFiles/serial_link_boot_test.dir/root/repo/src/serial_link.c.o.d"
+  "CMakeFiles/serial_link_boot_test.dir/serial_link_boot_test.c.o"
+  "CMakeFiles/serial_link_boot_test.dir/serial_link_boot_test.c.o.d"
+  "serial_link_boot_test"
+  "serial_link_boot_test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/serial_link_boot_test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
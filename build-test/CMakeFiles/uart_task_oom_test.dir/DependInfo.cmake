@@ -0,0 +1,23 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/src/crc.c" "CMakeFiles/uart_task_oom_test.dir/root/repo/src/crc.c.o" "gcc" "CMakeFiles/uart_task_oom_test.dir/root/repo/src/crc.c.o.d"
+  "/root/repo/src/serial_link.c" "CMakeFiles/uart_task_oom_test.dir/root/repo/src/serial_link.c.o" "gcc" "CMakeFiles/uart_task_oom_test.dir/root/repo/src/serial_link.c.o.d"
+  "/root/repo/src/uart_task.c" "CMakeFiles/uart_task_oom_test.dir/root/repo/src/uart_task.c.o" "gcc" "CMakeFiles/uart_task_oom_test.dir/root/repo/src/uart_task.c.o.d"
+  "/root/repo/test/uart_task_oom_test.c" "CMakeFiles/uart_task_oom_test.dir/uart_task_oom_test.c.o" "gcc" "CMakeFiles/uart_task_oom_test.dir/uart_task_oom_test.c.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  "/root/repo/build-test/CMakeFiles/sdk_sim.dir/DependInfo.cmake"
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -0,0 +1,17 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/uart_task_oom_test.dir/root/repo/src/crc.c.o"
+  "CMakeFiles/uart_task_oom_test.dir/root/repo/src/crc.c.o.d"
+  "CMakeFiles/uart_task_oom_test.dir/root/repo/src/serial_link.c.o"
+  "CMakeFiles/uart_task_oom_test.dir/root/repo/src/serial_link.c.o.d"
+  "CMakeFiles/uart_task_oom_test.dir/root/repo/src/uart_task.c.o"
+  "CMakeFiles/uart_task_oom_test.dir/root/repo/src/uart_task.c.o.d"
+  "CMakeFiles/uart_task_oom_test.dir/uart_task_oom_test.c.o"
+  "CMakeFiles/uart_task_oom_test.dir/uart_task_oom_test.c.o.d"
+  "uart_task_oom_test"
+  "uart_task_oom_test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/uart_task_oom_test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
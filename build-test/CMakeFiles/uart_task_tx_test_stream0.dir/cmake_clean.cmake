@@ -0,0 +1,17 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/uart_task_tx_test_stream0.dir/root/repo/src/crc.c.o"
+  "CMakeFiles/uart_task_tx_test_stream0.dir/root/repo/src/crc.c.o.d"
+  "CMakeFiles/uart_task_tx_test_stream0.dir/root/repo/src/serial_link.c.o"
+  "CMakeFiles/uart_task_tx_test_stream0.dir/root/repo/src/serial_link.c.o.d"
+  "CMakeFiles/uart_task_tx_test_stream0.dir/root/repo/src/uart_task.c.o"
+  "CMakeFiles/uart_task_tx_test_stream0.dir/root/repo/src/uart_task.c.o.d"
+  "CMakeFiles/uart_task_tx_test_stream0.dir/uart_task_tx_test.c.o"
+  "CMakeFiles/uart_task_tx_test_stream0.dir/uart_task_tx_test.c.o.d"
+  "uart_task_tx_test_stream0"
+  "uart_task_tx_test_stream0.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/uart_task_tx_test_stream0.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
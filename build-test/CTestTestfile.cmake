@@ -0,0 +1,54 @@
+# CMake generated Testfile for 
+# Source directory: /root/repo/test
+# Build directory: /root/repo/build-test
+# 
+# This file includes the relevant testing commands required for 
+# testing this directory and lists subdirectories to be tested as well.
+add_test(crc_bit "/root/repo/build-test/crc_test_bit")
+set_tests_properties(crc_bit PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;26;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(crc_nibble "/root/repo/build-test/crc_test_nibble")
+set_tests_properties(crc_nibble PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;26;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(crc_byte "/root/repo/build-test/crc_test_byte")
+set_tests_properties(crc_byte PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;26;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(serial_link "/root/repo/build-test/serial_link_test")
+set_tests_properties(serial_link PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;38;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(serial_link_bench_swar0 "/root/repo/build-test/serial_link_bench_swar0" "256")
+set_tests_properties(serial_link_bench_swar0 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;51;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(serial_link_bench_swar1 "/root/repo/build-test/serial_link_bench_swar1" "256")
+set_tests_properties(serial_link_bench_swar1 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;51;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(serial_link_boot "/root/repo/build-test/serial_link_boot_test")
+set_tests_properties(serial_link_boot PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;65;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(uart_task_credit "/root/repo/build-test/uart_task_credit_test")
+set_tests_properties(uart_task_credit PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;74;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(uart_task_tx_stream0 "/root/repo/build-test/uart_task_tx_test_stream0")
+set_tests_properties(uart_task_tx_stream0 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;87;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(uart_task_tx_stream1 "/root/repo/build-test/uart_task_tx_test_stream1")
+set_tests_properties(uart_task_tx_stream1 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;87;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(uart_task_ping "/root/repo/build-test/uart_task_ping_test")
+set_tests_properties(uart_task_ping PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;97;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(uart_task_link_stream0_0 "/root/repo/build-test/uart_task_link_test_stream0" "0")
+set_tests_properties(uart_task_link_stream0_0 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;111;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(uart_task_link_stream0_5 "/root/repo/build-test/uart_task_link_test_stream0" "5")
+set_tests_properties(uart_task_link_stream0_5 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;111;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(uart_task_link_stream0_10 "/root/repo/build-test/uart_task_link_test_stream0" "10")
+set_tests_properties(uart_task_link_stream0_10 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;111;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(uart_task_link_stream0_30 "/root/repo/build-test/uart_task_link_test_stream0" "30")
+set_tests_properties(uart_task_link_stream0_30 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;111;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(uart_task_link_stream1_0 "/root/repo/build-test/uart_task_link_test_stream1" "0")
+set_tests_properties(uart_task_link_stream1_0 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;111;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(uart_task_link_stream1_5 "/root/repo/build-test/uart_task_link_test_stream1" "5")
+set_tests_properties(uart_task_link_stream1_5 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;111;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(uart_task_link_stream1_10 "/root/repo/build-test/uart_task_link_test_stream1" "10")
+set_tests_properties(uart_task_link_stream1_10 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;111;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(uart_task_link_stream1_30 "/root/repo/build-test/uart_task_link_test_stream1" "30")
+set_tests_properties(uart_task_link_stream1_30 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;111;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(uart_task_lanes_stream0 "/root/repo/build-test/uart_task_lanes_test_stream0")
+set_tests_properties(uart_task_lanes_stream0 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;125;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(uart_task_lanes_stream1 "/root/repo/build-test/uart_task_lanes_test_stream1")
+set_tests_properties(uart_task_lanes_stream1 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;125;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(uart_task_dma "/root/repo/build-test/uart_task_dma_test")
+set_tests_properties(uart_task_dma PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;138;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(uart_task_dma_heap_full "/root/repo/build-test/uart_task_dma_test" "heap_full")
+set_tests_properties(uart_task_dma_heap_full PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;139;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(uart_task_oom "/root/repo/build-test/uart_task_oom_test")
+set_tests_properties(uart_task_oom PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;149;add_test;/root/repo/test/CMakeLists.txt;0;")
@@ -10,6 +10,7 @@ die() {
 
 make firmware-release -j$(($(nproc)+1))
 make firmware-debug -j$(($(nproc)+1))
+make test -j$(($(nproc)+1))
 
 ./scripts/print_metadata build-release/bitbox-da14531-firmware.bin
 
@@ -2,18 +2,19 @@
  * \file
  * Functions and types for CRC checks.
  *
- * Generated on Mon Mar  3 11:14:13 2025
- * by pycrc v0.10.0, https://pycrc.org
- * using the configuration:
+ * Derived from the output of pycrc v0.10.0, https://pycrc.org, for the
+ * bit-by-bit-fast and table-driven (4 and 8 bit index) algorithms, using the
+ * configuration:
  *  - Width         = 16
  *  - Poly          = 0x8005
  *  - XorIn         = 0x0000
  *  - ReflectIn     = True
  *  - XorOut        = 0x0000
  *  - ReflectOut    = True
- *  - Algorithm     = bit-by-bit-fast
  *
  * This file defines the functions crc_init(), crc_update() and crc_finalize().
+ * Unlike the generated header there is no crc_reflect(), the register is kept
+ * reflected so that crc_finalize() doesn't have to reflect it.
  *
  * The crc_init() function returns the initial \c crc value and must be called
  * before the first call to crc_update().
@@ -51,10 +52,22 @@ extern "C" {
 /**
  * The definition of the used algorithm.
  *
+ * The engine is picked with the CRC_ENGINE CMake option, which defines one of
+ * CRC_ENGINE_BIT, CRC_ENGINE_NIBBLE or CRC_ENGINE_BYTE. The byte table is used
+ * if none is defined.
+ *
  * This is not used anywhere in the generated code, but it may be used by the
  * application code to call algorithm-specific code, if desired.
  */
+#if defined(CRC_ENGINE_BIT)
 #define CRC_ALGO_BIT_BY_BIT_FAST 1
+#elif defined(CRC_ENGINE_NIBBLE)
+#define CRC_ALGO_TABLE_DRIVEN 1
+#define CRC_TABLE_IDX_WIDTH 4
+#else
+#define CRC_ALGO_TABLE_DRIVEN 1
+#define CRC_TABLE_IDX_WIDTH 8
+#endif
 
 
 /**
@@ -65,16 +78,6 @@ extern "C" {
 typedef uint_fast16_t crc_t;
 
 
-/**
- * Reflect all bits of a \a data word of \a data_len bytes.
- *
- * \param[in] data     The data word to be reflected.
- * \param[in] data_len The width of \a data expressed in number of bits.
- * \return             The reflected data.
- */
-crc_t crc_reflect(crc_t data, size_t data_len);
-
-
 /**
  * Calculate the initial crc value.
  *
@@ -97,6 +100,63 @@ static inline crc_t crc_init(void)
 crc_t crc_update(crc_t crc, const void *data, size_t data_len);
 
 
+/**
+ * Update the crc value with a single byte.
+ *
+ * Used where data is produced one byte at a time, for example while
+ * (un)escaping a frame on the serial link. Inline, as it runs once per byte
+ * on the UART path.
+ *
+ * \param[in] crc      The current crc value.
+ * \param[in] data     The byte to add to the crc.
+ * \return             The updated crc value.
+ */
+#if defined(CRC_ALGO_BIT_BY_BIT_FAST)
+static inline crc_t crc_update_byte(crc_t crc, uint8_t data)
+{
+    unsigned int i;
+
+    crc ^= data;
+    for (i = 0; i < 8; i++) {
+        if (crc & 0x0001) {
+            crc = (crc >> 1) ^ 0xa001;
+        } else {
+            crc >>= 1;
+        }
+    }
+    return crc & 0xffff;
+}
+#elif CRC_TABLE_IDX_WIDTH == 4
+/** Table of the table-driven implementation, defined in crc.c. */
+extern const uint16_t crc_table[16];
+
+static inline crc_t crc_update_byte(crc_t crc, uint8_t data)
+{
+    crc = crc_table[(crc ^ data) & 0x0f] ^ (crc >> 4);
+    crc = crc_table[(crc ^ (data >> 4)) & 0x0f] ^ (crc >> 4);
+    return crc & 0xffff;
+}
+#else
+/** Table of the table-driven implementation, defined in crc.c. */
+extern const uint16_t crc_table[256];
+
+static inline crc_t crc_update_byte(crc_t crc, uint8_t data)
+{
+    return (crc_table[(crc ^ data) & 0xff] ^ (crc >> 8)) & 0xffff;
+}
+#endif
+
+
+/**
+ * The crc value of a message followed by its own (finalized, little endian)
+ * crc.
+ *
+ * This allows a receiver to check a message without knowing where the crc
+ * starts.
+ */
+#define CRC_RESIDUE 0x0000
+
+
 /**
  * Calculate the final crc value.
  *
@@ -105,7 +165,7 @@ crc_t crc_update(crc_t crc, const void *data, size_t data_len);
  */
 static inline crc_t crc_finalize(crc_t crc)
 {
-    return crc_reflect(crc, 16);
+    return crc;
 }
 
 
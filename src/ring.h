@@ -0,0 +1,85 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RING_H
+#define RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "util.h"
+
+/// Byte ring buffer
+///
+/// `rd` and `wr` are free running and only masked when the buffer is indexed,
+/// so a full buffer can be told apart from an empty one. `size` must be a power
+/// of two.
+///
+/// One producer and one consumer may use the ring concurrently, e.g. an
+/// interrupt writing and a task reading, without disabling interrupts: only the
+/// producer writes `wr` and only the consumer writes `rd`. The Cortex-M0+
+/// doesn't reorder memory accesses, so keeping the compiler from moving the
+/// buffer accesses across the index update is enough.
+struct ring {
+  uint8_t *buf;
+  uint16_t size;
+  volatile uint16_t rd;
+  volatile uint16_t wr;
+};
+
+#define RING_INIT(storage)                                                     \
+  {.buf = (storage), .size = sizeof(storage), .rd = 0, .wr = 0}
+
+/// Number of unread bytes
+static inline uint16_t ring_len(const struct ring *r) {
+  return (uint16_t)(r->wr - r->rd);
+}
+
+/// Number of bytes that can be written
+static inline uint16_t ring_free(const struct ring *r) {
+  return r->size - ring_len(r);
+}
+
+/// Points `data` to the unread bytes and returns how many of them are
+/// contiguous in memory. Call again after ring_consume() to get the part that
+/// wrapped around.
+static inline uint16_t ring_peek(const struct ring *r, const uint8_t **data) {
+  uint16_t offset = r->rd & (r->size - 1);
+  *data = &r->buf[offset];
+  return MIN(ring_len(r), r->size - offset);
+}
+
+/// Marks `len` bytes as read
+static inline void ring_consume(struct ring *r, uint16_t len) {
+  // The bytes are read before the producer may write over them
+  __asm__ volatile("" ::: "memory");
+  r->rd += len;
+}
+
+/// Points `data` to the free space and returns how many bytes can be written
+/// contiguously. Make them visible with ring_commit().
+static inline uint16_t ring_reserve(struct ring *r, uint8_t **data) {
+  uint16_t offset = r->wr & (r->size - 1);
+  *data = &r->buf[offset];
+  return MIN(ring_free(r), r->size - offset);
+}
+
+/// Marks `len` bytes as written
+static inline void ring_commit(struct ring *r, uint16_t len) {
+  // The bytes are written before the consumer may read them
+  __asm__ volatile("" ::: "memory");
+  r->wr += len;
+}
+
+#endif
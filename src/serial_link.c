@@ -12,7 +12,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <arch_system.h>
 #include <crc.h>
+#include <stddef.h>
+#include <string.h>
 #include <uart.h>
 
 #include "debug.h"
@@ -23,173 +26,749 @@
 #define SL_ESCAPE 0x7D
 #define SL_XOR 0x20
 #define STX 0x02
+#define SL_COBS_DELIMITER 0x00
 
-enum serial_link_state {
-  SERIAL_LINK_WAIT,
-  SERIAL_LINK_ACCEPT,
-  SERIAL_LINK_ESCAPE,
-};
+// Scan the payload for SOF/ESCAPE a word at a time
+#ifndef SERIAL_LINK_SWAR
+#define SERIAL_LINK_SWAR 1
+#endif
+
+// The parser state of a stream is three pointers and 16 bytes without
+// padding in between, 28 bytes on the DA14531
+_Static_assert(offsetof(struct sl_parser, state) == 3 * sizeof(uint8_t *) + 15,
+               "sl_parser grew");
+
+// Framing of formatted frames and of new parsers
+static uint8_t sl_framing = SL_FRAMING_ESCAPE;
+
+void serial_link_set_framing(enum sl_framing framing) {
+  sl_framing = framing;
+}
+
+enum sl_framing serial_link_framing(void) { return sl_framing; }
+
+uint16_t serial_link_frame_len_max(uint16_t payload_len) {
+  if (sl_framing != SL_FRAMING_COBS) {
+    return SERIAL_LINK_FRAME_LEN_MAX(payload_len);
+  }
+  // Two delimiters and a code byte per started block of 254 bytes
+  uint16_t len = 5 + payload_len + 2;
+  return 2 + len + len / 254 + 1;
+}
+
+uint16_t serial_link_frame_len_bound(const uint8_t *payload,
+                                     uint16_t payload_len) {
+  if (sl_framing == SL_FRAMING_COBS) {
+    return serial_link_frame_len_max(payload_len);
+  }
+  uint16_t escaped = 0;
+  for (uint16_t i = 0; i < payload_len; i++) {
+    if (payload[i] == SL_SOF || payload[i] == SL_ESCAPE || payload[i] == STX) {
+      escaped++;
+    }
+  }
+  return 2 + 2 * (5 + 2) + payload_len + escaped;
+}
+
+void sl_parser_init(struct sl_parser *p, uint8_t *frame, uint16_t frame_cap,
+                    sl_payload_alloc_t alloc) {
+  p->payload = NULL;
+  p->alloc = alloc;
+  p->frame = frame;
+  p->frame_cap = frame_cap;
+  p->frame_len = 0;
+  p->crc = crc_init();
+  // Until the first byte of a frame tells otherwise
+  p->header_len = 3;
+  p->framing = sl_framing;
+  p->state = SERIAL_LINK_WAIT;
+}
+
+// The header of a frame is complete, find out where the payload goes. Drops
+// the frame if there is no room for it.
+static void _serial_link_header_complete(struct sl_parser *p) {
+  if (sl_parser_payload_len(p) == 0) {
+    // Nothing to store, for example ACK and NAK
+    p->payload = p->frame;
+    return;
+  }
+  if (p->alloc != NULL) {
+    p->payload = p->alloc(p);
+  } else if (sl_parser_payload_len(p) <= p->frame_cap) {
+    p->payload = p->frame;
+  } else {
+    p->payload = NULL;
+  }
+
+  if (p->payload == NULL) {
+    LOG("dropped frame, len %d\n", sl_parser_payload_len(p));
+    p->frame_len = 0;
+    p->state = SERIAL_LINK_WAIT;
+  }
+}
+
+// Store an unescaped byte of the frame and add it to the running crc. The crc
+// restarts with the first byte of every frame. The header is kept in the
+// parser, the payload goes to its destination and the crc is only added to
+// the running crc.
+static inline void _serial_link_accept_byte(struct sl_parser *p,
+                                            uint8_t data) {
+  if (p->frame_len == 0) {
+    p->crc = crc_init();
+  }
+  p->crc = crc_update_byte(p->crc, data);
+  uint16_t idx = p->frame_len++;
+  if (idx == 0) {
+    p->header_len = sl_packet_type_is_seq(data) ? 5 : 3;
+  }
+  if (idx < p->header_len) {
+    p->header[idx] = data;
+    if (idx == p->header_len - 1) {
+      _serial_link_header_complete(p);
+    }
+    return;
+  }
+  idx -= p->header_len;
+  // Bytes beyond the announced length are only counted, the length check fails
+  // once the frame is complete.
+  if (idx < sl_parser_payload_len(p)) {
+    p->payload[idx] = data;
+  }
+}
+
+// Store a run of plain payload bytes, none of them SOF or ESCAPE
+static inline void _serial_link_accept_run(struct sl_parser *p,
+                                           const uint8_t *data, uint16_t len) {
+  memcpy(&p->payload[p->frame_len - p->header_len], data, len);
+  p->crc = crc_update(p->crc, data, len);
+  p->frame_len += len;
+}
+
+#if SERIAL_LINK_SWAR
+// Word access to the stream, which is a byte buffer
+typedef uint32_t __attribute__((may_alias)) sl_word_t;
+
+// Non-zero if any byte in `w` is one of 0x7c..0x7f, which includes SL_SOF and
+// SL_ESCAPE. Setting the two low bits maps all of them to 0x7f, the xor turns
+// that into a zero byte and the rest is the classic has-zero-byte test.
+static inline uint32_t _serial_link_word_maybe_special(uint32_t w) {
+  uint32_t t = (w | 0x03030303) ^ 0x7f7f7f7f;
+  return (t - 0x01010101) & ~t & 0x80808080;
+}
+#endif
+
+// Number of payload bytes of the current frame that are still to come. Zero
+// while in the header or crc, which are short and go through the state
+// machine.
+static inline uint16_t _serial_link_payload_left(const struct sl_parser *p) {
+  uint16_t payload_end = sl_parser_payload_len(p) + p->header_len;
+  if (p->frame_len < p->header_len || p->frame_len >= payload_end) {
+    return 0;
+  }
+  return payload_end - p->frame_len;
+}
+
+// Length of the run of plain bytes at the start of `data` that belong to the
+// payload of the current frame
+static uint16_t _serial_link_payload_run(const struct sl_parser *p,
+                                         const uint8_t *data,
+                                         uint16_t data_len) {
+  uint16_t len = MIN(data_len, _serial_link_payload_left(p));
+  uint16_t i = 0;
+#if SERIAL_LINK_SWAR
+  // Byte by byte up to a word boundary, Cortex-M0+ can't do unaligned loads
+  while (i < len && ((uintptr_t)&data[i] & 3) != 0) {
+    if (data[i] == SL_SOF || data[i] == SL_ESCAPE) {
+      return i;
+    }
+    i++;
+  }
+  // Word by word, only words that may contain a special byte are looked at
+  // closer
+  while (i + 4 <= len) {
+    if (_serial_link_word_maybe_special(*(const sl_word_t *)&data[i])) {
+      for (uint16_t j = i; j < i + 4; j++) {
+        if (data[j] == SL_SOF || data[j] == SL_ESCAPE) {
+          return j;
+        }
+      }
+    }
+    i += 4;
+  }
+#endif
+  while (i < len && data[i] != SL_SOF && data[i] != SL_ESCAPE) {
+    i++;
+  }
+  return i;
+}
 
 /// Will read out the next frame from the stream. Returns true if there is
-/// a complete frame in the output, or false in case it needs more bytes.
+/// a complete frame in `p`, or false in case it needs more bytes.
 ///
-/// buf - Buffer to read from, there might be unread bytes in case there was
-///       more than one frame in the buffer
-/// buf_len - length of content in buffer. Will be updated in case there are
-///           unread bytes
-/// frame - Buffer to write to
-/// frame_len - how many bytes were written to `frame` buffer
-/// frame_cap - capacity of `frame`. how many bytes long the buffer is
+/// data - Bytes to read from
+/// data_len - Number of bytes in `data`
+/// consumed - How many bytes of `data` were used. Less than `data_len` in case
+///            a frame was completed before the end of `data`.
 ///
-/// if it returns PACKET_TYPE_ERR send a NAK back
-bool serial_link_parse_frame(uint8_t *buf, uint16_t *buf_len, uint8_t *frame,
-                             uint16_t *frame_len, uint16_t frame_cap) {
-  static enum serial_link_state state = SERIAL_LINK_WAIT;
-
-  for (int i = 0; i < *buf_len && *frame_len < frame_cap; i++) {
-    // LOG("i:%d,b:%02x,f:%d\n", i, buf[i], *frame_len);
-    switch (state) {
+/// `p->crc` is the running crc over all bytes of the frame, including the crc
+/// at the end of the frame. It equals CRC_RESIDUE for an intact frame.
+static bool serial_link_parse_frame(struct sl_parser *p, const uint8_t *data,
+                                    uint16_t data_len, uint16_t *consumed) {
+  // The previous frame has been handed to the caller, start over
+  if (p->state == SERIAL_LINK_DONE) {
+    p->frame_len = 0;
+    p->state = SERIAL_LINK_ACCEPT;
+  }
+
+  uint16_t i;
+  for (i = 0; i < data_len; i++) {
+    // LOG("i:%d,b:%02x,f:%d\n", i, data[i], p->frame_len);
+    switch (p->state) {
     case SERIAL_LINK_WAIT:
-      if (buf[i] == SL_SOF) {
-        state = SERIAL_LINK_ACCEPT;
+      if (data[i] == SL_SOF) {
+        p->state = SERIAL_LINK_ACCEPT;
       }
       break;
     case SERIAL_LINK_ACCEPT:
-      if (buf[i] == SL_SOF) {
-        if (*frame_len >= 3) {
-
-          // Move any bytes we didn't use to the beginning
-          memmove(&buf[0], &buf[i + 1], *buf_len - i - 1);
-          *buf_len = *buf_len - i - 1;
-
+      if (data[i] == SL_SOF) {
+        if (p->frame_len >= 3) {
+          // The closing SOF may also open the next frame, so DONE continues
+          // like ACCEPT.
+          p->state = SERIAL_LINK_DONE;
+          *consumed = i + 1;
           return true;
         }
-        *frame_len = 0;
-      } else if (buf[i] == SL_ESCAPE) {
-        state = SERIAL_LINK_ESCAPE;
+        p->frame_len = 0;
+      } else if (data[i] == SL_ESCAPE) {
+        p->state = SERIAL_LINK_ESCAPE;
       } else {
-        frame[(*frame_len)++] = buf[i];
+        // Fast path for the payload, most bytes don't need to be unescaped
+        uint16_t run = _serial_link_payload_run(p, &data[i], data_len - i);
+        if (run > 0) {
+          _serial_link_accept_run(p, &data[i], run);
+          i += run - 1;
+        } else {
+          _serial_link_accept_byte(p, data[i]);
+        }
       }
       break;
     case SERIAL_LINK_ESCAPE:
-      frame[(*frame_len)++] = buf[i] ^ SL_XOR;
-      state = SERIAL_LINK_ACCEPT;
+      // Before accepting the byte, which might drop the frame
+      p->state = SERIAL_LINK_ACCEPT;
+      _serial_link_accept_byte(p, data[i] ^ SL_XOR);
+      break;
+    case SERIAL_LINK_DONE:
       break;
     }
   }
-  *buf_len = 0;
+  *consumed = i;
   return false;
 }
 
-///
-enum sl_status serial_link_parse_packet(uint8_t *buf, uint16_t *buf_len,
-                                        uint8_t *frame, uint16_t *frame_len,
-                                        uint16_t frame_cap) {
+// Same as serial_link_parse_frame for COBS framing. Frames are delimited by
+// zeros, the zeros within a frame are restored from the code bytes.
+static bool serial_link_parse_frame_cobs(struct sl_parser *p,
+                                         const uint8_t *data,
+                                         uint16_t data_len,
+                                         uint16_t *consumed) {
+  // The closing delimiter also opened the next frame
+  if (p->state == SERIAL_LINK_DONE) {
+    p->frame_len = 0;
+    p->cobs_left = 0;
+    p->cobs_code = 0xff;
+    p->state = SERIAL_LINK_ACCEPT;
+  }
 
-  bool frame_complete =
-      serial_link_parse_frame(buf, buf_len, frame, frame_len, frame_cap);
+  uint16_t i;
+  for (i = 0; i < data_len; i++) {
+    if (data[i] == SL_COBS_DELIMITER) {
+      if (p->state == SERIAL_LINK_ACCEPT && p->frame_len >= 3) {
+        p->state = SERIAL_LINK_DONE;
+        *consumed = i + 1;
+        return true;
+      }
+      p->state = SERIAL_LINK_ACCEPT;
+      p->frame_len = 0;
+      p->cobs_left = 0;
+      // The first block isn't preceded by an implicit zero
+      p->cobs_code = 0xff;
+    } else if (p->state != SERIAL_LINK_ACCEPT) {
+      // Wait for a delimiter
+    } else if (p->cobs_left == 0) {
+      // A code byte, the previous block ended with a zero unless it was a
+      // full one
+      if (p->cobs_code != 0xff) {
+        _serial_link_accept_byte(p, 0);
+      }
+      p->cobs_code = data[i];
+      p->cobs_left = data[i] - 1;
+    } else {
+      // Fast path for the payload, a block is copied as is
+      uint16_t run = MIN(MIN(p->cobs_left, data_len - i),
+                         _serial_link_payload_left(p));
+      const uint8_t *zero = memchr(&data[i], SL_COBS_DELIMITER, run);
+      if (zero != NULL) {
+        run = zero - &data[i];
+      }
+      if (run > 0) {
+        _serial_link_accept_run(p, &data[i], run);
+        p->cobs_left -= run;
+        i += run - 1;
+      } else {
+        _serial_link_accept_byte(p, data[i]);
+        p->cobs_left--;
+      }
+    }
+  }
+  *consumed = i;
+  return false;
+}
 
-  // We ran out of space in frame buffer while reading bytes
-  if (*frame_len == frame_cap) {
-    ASSERT_ERROR(false);
+// Check a complete frame and map its type to a status
+static enum sl_status serial_link_check_frame(const struct sl_parser *p) {
+  // LOG("serial_link_parse_packet, frame len: %d\n", p->frame_len);
+  if (p->frame_len < p->header_len ||
+      p->frame_len != sl_parser_payload_len(p) + p->header_len + 2 ||
+      (p->framing == SL_FRAMING_COBS && p->cobs_left != 0)) {
+    // Invalid length
     return SL_ERR;
   }
 
-  if (frame_complete) {
-    // LOG("serial_link_parse_packet, frame len: %d\n", *frame_len);
-    uint8_t type = frame[0];
-    uint16_t len = frame[1] | frame[2] << 8;
-    if (*frame_len != len + 5 || *frame_len < 5) {
-      // Invalid length
-      return SL_NONE;
-    }
-    uint16_t crc_frame = frame[3 + len] | frame[3 + len + 1] << 8;
-
-    crc_t crc = crc_init();
-    crc = crc_update(crc, &frame[0], 3 + len);
-    crc = crc_finalize(crc);
+  // The crc was updated while the frame was unescaped and also covers the
+  // crc at the end of the frame.
+  if (crc_finalize(p->crc) != CRC_RESIDUE) {
+    LOG("INVALID CRC\n");
+    return SL_ERR;
+  }
 
-    // LOG("len %d, type %d, crc_frame: %04x, crc: %04x\n", len, cmd,
-    //              crc_frame, crc);
+  // TODO: do error correction, bits 7:4 and 3:0 in type are the same but
+  // complemented
+  switch (sl_packet_type_plain(sl_parser_type(p))) {
+  case SL_PT_ACK:
+    return SL_PACKET_TYPE_ACK;
+  case SL_PT_NAK:
+    return SL_PACKET_TYPE_NAK;
+  case SL_PT_BLE_DATA:
+    return SL_PACKET_TYPE_BLE_DATA;
+  case SL_PT_CTRL_DATA:
+    return SL_PACKET_TYPE_CTRL_DATA;
+  case SL_PT_PING:
+    return SL_PACKET_TYPE_PING;
+  }
+  return SL_ERR;
+}
 
-    if (crc_frame != crc) {
-      LOG("INVALID CRC\n");
-      return SL_ERR;
+enum sl_status serial_link_parse_packet_ring(struct sl_parser *p,
+                                             struct ring *rx) {
+  const uint8_t *data;
+  uint16_t data_len;
+  // At most two iterations, the second one in case the unread bytes wrap
+  // around the end of the ring
+  while ((data_len = ring_peek(rx, &data)) > 0) {
+    uint16_t consumed;
+    bool frame_complete =
+        p->framing == SL_FRAMING_COBS
+            ? serial_link_parse_frame_cobs(p, data, data_len, &consumed)
+            : serial_link_parse_frame(p, data, data_len, &consumed);
+    ring_consume(rx, consumed);
+
+    if (frame_complete) {
+      return serial_link_check_frame(p);
     }
+  }
+  return SL_NONE;
+}
 
-    // TODO: do error correction, bits 7:4 and 3:0 in type are the same but
-    // complemented
-    switch (type) {
-    case SL_PT_ACK:
-      return SL_PACKET_TYPE_ACK;
-    case SL_PT_NAK:
-      return SL_PACKET_TYPE_NAK;
-    case SL_PT_BLE_DATA:
-      return SL_PACKET_TYPE_BLE_DATA;
-    case SL_PT_CTRL_DATA:
-      return SL_PACKET_TYPE_CTRL_DATA;
-    case SL_PT_PING:
-      return SL_PACKET_TYPE_PING;
-    }
+enum sl_status serial_link_parse_packet(struct sl_parser *p, uint8_t *buf,
+                                        uint16_t *buf_len) {
+  uint16_t consumed;
+  bool frame_complete =
+      p->framing == SL_FRAMING_COBS
+          ? serial_link_parse_frame_cobs(p, buf, *buf_len, &consumed)
+          : serial_link_parse_frame(p, buf, *buf_len, &consumed);
+
+  // Move any bytes we didn't use to the beginning
+  memmove(&buf[0], &buf[consumed], *buf_len - consumed);
+  *buf_len -= consumed;
+
+  if (frame_complete) {
+    return serial_link_check_frame(p);
   }
   return SL_NONE;
 }
 
+// Output of the frame being formatted
+struct sl_encoder {
+  uint8_t *buf;
+  uint16_t buf_len;
+  uint16_t idx;
+  // Where the code byte of the current COBS block goes, and its value
+  uint16_t code_idx;
+  uint8_t code;
+  uint8_t framing;
+};
+
 // We also escape STX so that the MCU can detect if the BLE chip has been
 // reset.
-static void _serial_link_format_byte(uint8_t data, uint8_t *buf,
-                                     uint16_t buf_len, uint16_t *idx) {
-  ASSERT_ERROR(*idx + 2 < buf_len);
+static inline void _serial_link_escape_byte(struct sl_encoder *e,
+                                            uint8_t data) {
+  ASSERT_ERROR(e->idx + 2 < e->buf_len);
   switch (data) {
   case SL_SOF:
   case SL_ESCAPE:
   case STX:
-    buf[(*idx)++] = SL_ESCAPE;
-    buf[(*idx)++] = data ^ SL_XOR;
+    e->buf[e->idx++] = SL_ESCAPE;
+    e->buf[e->idx++] = data ^ SL_XOR;
     break;
   default:
-    buf[(*idx)++] = data;
+    e->buf[e->idx++] = data;
     break;
   }
 }
 
-/// Formats a packet into buf for sending over serial
-/// Returns number of bytes formatted
-uint16_t serial_link_format(uint8_t *buf, uint16_t buf_len, uint8_t typ,
-                            const uint8_t *payload, uint16_t payload_len) {
-  uint16_t idx = 0;
-  crc_t crc = crc_init();
+// Zeros end the current block, its code byte is the distance to the zero. A
+// block also ends after 254 bytes, without an implicit zero.
+static inline void _serial_link_cobs_byte(struct sl_encoder *e, uint8_t data) {
+  ASSERT_ERROR(e->idx + 1 < e->buf_len);
+  if (data != 0) {
+    e->buf[e->idx++] = data;
+    e->code++;
+    if (e->code != 0xff) {
+      return;
+    }
+  }
+  e->buf[e->code_idx] = e->code;
+  e->code_idx = e->idx++;
+  e->code = 1;
+}
+
+static inline void _serial_link_encode_byte(struct sl_encoder *e,
+                                            uint8_t data) {
+  if (e->framing == SL_FRAMING_COBS) {
+    _serial_link_cobs_byte(e, data);
+  } else {
+    _serial_link_escape_byte(e, data);
+  }
+}
 
-  ASSERT_ERROR(idx + 1 < buf_len);
-  buf[idx++] = SL_SOF;
+// Add a byte to the crc and encode it, so that every byte is only visited
+// once.
+static inline void _serial_link_format_byte(struct sl_encoder *e, crc_t *crc,
+                                            uint8_t data) {
+  *crc = crc_update_byte(*crc, data);
+  _serial_link_encode_byte(e, data);
+}
 
-  crc = crc_update(crc, &typ, 1);
-  _serial_link_format_byte(typ, buf, buf_len, &idx);
+// Formats a frame, `ext` are the header bytes that follow the length
+static uint16_t _serial_link_format(uint8_t *buf, uint16_t buf_len, uint8_t typ,
+                                   const uint8_t *ext, uint8_t ext_len,
+                                   const struct sl_iov *iov, uint8_t iov_cnt) {
+  struct sl_encoder e = {.buf = buf, .buf_len = buf_len, .framing = sl_framing};
+  crc_t crc = crc_init();
+  uint8_t delimiter =
+      sl_framing == SL_FRAMING_COBS ? SL_COBS_DELIMITER : SL_SOF;
 
-  uint8_t len = payload_len & 0xff;
-  crc = crc_update(crc, &len, 1);
-  _serial_link_format_byte(len, buf, buf_len, &idx);
+  uint16_t payload_len = 0;
+  for (int i = 0; i < iov_cnt; i++) {
+    payload_len += iov[i].len;
+  }
 
-  len = (payload_len >> 8) & 0xff;
-  crc = crc_update(crc, &len, 1);
-  _serial_link_format_byte(len, buf, buf_len, &idx);
+  ASSERT_ERROR(e.idx + 2 < buf_len);
+  buf[e.idx++] = delimiter;
+  if (sl_framing == SL_FRAMING_COBS) {
+    // Room for the code byte of the first block
+    e.code_idx = e.idx++;
+    e.code = 1;
+  }
 
-  for (int i = 0; i < payload_len; i++) {
-    _serial_link_format_byte(payload[i], buf, buf_len, &idx);
+  _serial_link_format_byte(&e, &crc, typ);
+  _serial_link_format_byte(&e, &crc, payload_len & 0xff);
+  _serial_link_format_byte(&e, &crc, (payload_len >> 8) & 0xff);
+  for (int i = 0; i < ext_len; i++) {
+    _serial_link_format_byte(&e, &crc, ext[i]);
+  }
+
+  for (int i = 0; i < iov_cnt; i++) {
+    for (int j = 0; j < iov[i].len; j++) {
+      _serial_link_format_byte(&e, &crc, iov[i].data[j]);
+    }
   }
 
-  crc = crc_update(crc, &payload[0], payload_len);
   crc = crc_finalize(crc);
 
   // crc_t is the "fastest" type that holds u16, so can be longer than 2
   // bytes
   for (int i = 0; i < sizeof(uint16_t); i++) {
-    _serial_link_format_byte(crc & 0xff, buf, buf_len, &idx);
+    _serial_link_encode_byte(&e, crc & 0xff);
     crc >>= 8;
   }
-  ASSERT_ERROR(idx + 1 < buf_len);
-  buf[idx++] = SL_SOF;
-  return idx;
+  if (sl_framing == SL_FRAMING_COBS) {
+    // The last block ends at the delimiter
+    e.buf[e.code_idx] = e.code;
+  }
+  ASSERT_ERROR(e.idx + 1 < buf_len);
+  buf[e.idx++] = delimiter;
+  return e.idx;
+}
+
+uint16_t serial_link_format_iov(uint8_t *buf, uint16_t buf_len, uint8_t typ,
+                                const struct sl_iov *iov, uint8_t iov_cnt) {
+  return _serial_link_format(buf, buf_len, typ, NULL, 0, iov, iov_cnt);
+}
+
+uint16_t serial_link_format_seq(uint8_t *buf, uint16_t buf_len, uint8_t typ,
+                                uint8_t seq, uint8_t ack,
+                                const struct sl_iov *iov, uint8_t iov_cnt) {
+  const uint8_t ext[] = {seq, ack};
+  return _serial_link_format(buf, buf_len, sl_packet_type_seq(typ), &ext[0],
+                             sizeof(ext), iov, iov_cnt);
+}
+
+/// Formats a packet into buf for sending over serial
+/// Returns number of bytes formatted
+uint16_t serial_link_format(uint8_t *buf, uint16_t buf_len, uint8_t typ,
+                            const uint8_t *payload, uint16_t payload_len) {
+  const struct sl_iov iov = {.data = payload, .len = payload_len};
+  return serial_link_format_iov(buf, buf_len, typ, &iov, 1);
+}
+
+// A zeroed sl_stream is done
+enum sl_stream_state {
+  SL_STREAM_DONE,
+  SL_STREAM_START,
+  SL_STREAM_BODY,
+};
+
+static void _sl_stream_init(struct sl_stream *s, uint8_t typ,
+                            const uint8_t *ext, uint8_t ext_len,
+                            const uint8_t *payload, uint16_t payload_len) {
+  s->payload = payload;
+  s->payload_len = payload_len;
+  s->idx = 0;
+  s->header[0] = typ;
+  s->header[1] = payload_len & 0xff;
+  s->header[2] = (payload_len >> 8) & 0xff;
+  for (int i = 0; i < ext_len; i++) {
+    s->header[3 + i] = ext[i];
+  }
+  s->header_len = 3 + ext_len;
+  s->framing = sl_framing;
+  s->escaped = 0;
+  s->cobs_left = 0;
+  s->cobs_zero = false;
+  s->cobs_last = false;
+  s->state = SL_STREAM_START;
+  crc_t crc = crc_init();
+  if (sl_framing == SL_FRAMING_COBS) {
+    crc = crc_update(crc, s->header, s->header_len);
+    crc = crc_finalize(crc_update(crc, payload, payload_len));
+  }
+  s->crc = crc;
+}
+
+void sl_stream_init(struct sl_stream *s, uint8_t typ, const uint8_t *payload,
+                    uint16_t payload_len) {
+  _sl_stream_init(s, typ, NULL, 0, payload, payload_len);
+}
+
+void sl_stream_init_seq(struct sl_stream *s, uint8_t typ, uint8_t seq,
+                        uint8_t ack, const uint8_t *payload,
+                        uint16_t payload_len) {
+  const uint8_t ext[] = {seq, ack};
+  _sl_stream_init(s, sl_packet_type_seq(typ), &ext[0], sizeof(ext), payload,
+                  payload_len);
+}
+
+// Length of the unescaped frame, header, payload and crc
+static inline uint16_t _sl_stream_len(const struct sl_stream *s) {
+  return s->header_len + s->payload_len + sizeof(uint16_t);
+}
+
+// Unescaped byte `idx` of the frame. The crc bytes are only valid once the
+// bytes before them have been taken, or with COBS.
+static inline uint8_t _sl_stream_at(const struct sl_stream *s, uint16_t idx) {
+  uint16_t crc_idx = s->header_len + s->payload_len;
+  if (idx < s->header_len) {
+    return s->header[idx];
+  }
+  if (idx < crc_idx) {
+    return s->payload[idx - s->header_len];
+  }
+  return (s->crc >> (8 * (idx - crc_idx))) & 0xff;
+}
+
+// Takes the next unescaped byte, and adds it to the running crc
+static inline uint8_t _sl_stream_take(struct sl_stream *s) {
+  uint16_t crc_idx = s->header_len + s->payload_len;
+  uint8_t data = _sl_stream_at(s, s->idx);
+  if (s->idx < crc_idx) {
+    s->crc = crc_update_byte(s->crc, data);
+    if (s->idx + 1 == crc_idx) {
+      s->crc = crc_finalize(s->crc);
+    }
+  }
+  s->idx++;
+  return data;
+}
+
+// Same as _serial_link_escape_byte, one output byte at a time
+static inline uint8_t _sl_stream_escape_next(struct sl_stream *s) {
+  if (s->escaped != 0) {
+    uint8_t data = s->escaped;
+    s->escaped = 0;
+    return data;
+  }
+  if (s->idx == _sl_stream_len(s)) {
+    s->state = SL_STREAM_DONE;
+    return SL_SOF;
+  }
+  uint8_t data = _sl_stream_take(s);
+  switch (data) {
+  case SL_SOF:
+  case SL_ESCAPE:
+  case STX:
+    s->escaped = data ^ SL_XOR;
+    return SL_ESCAPE;
+  default:
+    return data;
+  }
+}
+
+// Same blocks as _serial_link_cobs_byte. A block starts with its code byte, so
+// the bytes up to the next zero are looked at first.
+static inline uint8_t _sl_stream_cobs_next(struct sl_stream *s) {
+  if (s->cobs_left > 0) {
+    uint8_t data = _sl_stream_at(s, s->idx++);
+    if (--s->cobs_left == 0 && s->cobs_zero) {
+      s->idx++;
+    }
+    return data;
+  }
+  if (s->cobs_last) {
+    s->state = SL_STREAM_DONE;
+    return SL_COBS_DELIMITER;
+  }
+  uint16_t left = _sl_stream_len(s) - s->idx;
+  uint8_t n = 0;
+  while (n < 0xfe && n < left && _sl_stream_at(s, s->idx + n) != 0) {
+    n++;
+  }
+  s->cobs_left = n;
+  s->cobs_zero = n < left && n < 0xfe;
+  s->cobs_last = n == left && n < 0xfe;
+  if (n == 0 && s->cobs_zero) {
+    s->idx++;
+  }
+  return n + 1;
+}
+
+uint16_t sl_stream_read(struct sl_stream *s, uint8_t *buf, uint16_t buf_len) {
+  uint16_t len = 0;
+  while (len < buf_len && s->state != SL_STREAM_DONE) {
+    if (s->state == SL_STREAM_START) {
+      s->state = SL_STREAM_BODY;
+      buf[len++] = s->framing == SL_FRAMING_COBS ? SL_COBS_DELIMITER : SL_SOF;
+    } else if (s->framing == SL_FRAMING_COBS) {
+      buf[len++] = _sl_stream_cobs_next(s);
+    } else {
+      buf[len++] = _sl_stream_escape_next(s);
+    }
+  }
+  return len;
+}
+
+bool sl_stream_done(const struct sl_stream *s) {
+  return s->state == SL_STREAM_DONE;
+}
+
+// Runs shorter than this are cheaper as literals
+#define SL_RLE_RUN_MIN 3
+#define SL_RLE_RUN_MAX (0x7f + SL_RLE_RUN_MIN)
+#define SL_RLE_LITERAL_MAX 128
+#define SL_RLE_RUN 0x80
+
+// Length of the run of equal bytes at in[0], up to SL_RLE_RUN_MAX
+static uint16_t sl_rle_run(const uint8_t *in, uint16_t in_len) {
+  uint16_t run = 1;
+  while (run < in_len && run < SL_RLE_RUN_MAX && in[run] == in[0]) {
+    run++;
+  }
+  return run;
+}
+
+uint16_t sl_rle_encode(uint8_t *out, uint16_t out_len, const uint8_t *in,
+                       uint16_t in_len) {
+  uint16_t o = 0;
+  uint16_t i = 0;
+  while (i < in_len) {
+    uint16_t run = sl_rle_run(&in[i], in_len - i);
+    if (run >= SL_RLE_RUN_MIN) {
+      if (out != NULL) {
+        if (o + 2 > out_len) {
+          return 0;
+        }
+        out[o] = SL_RLE_RUN | (run - SL_RLE_RUN_MIN);
+        out[o + 1] = in[i];
+      }
+      o += 2;
+      i += run;
+      continue;
+    }
+    // Literals up to the next run that is worth it
+    uint16_t start = i;
+    do {
+      i += run;
+    } while (i < in_len && i - start < SL_RLE_LITERAL_MAX &&
+             (run = sl_rle_run(&in[i], in_len - i)) < SL_RLE_RUN_MIN);
+    uint16_t len = MIN(i - start, SL_RLE_LITERAL_MAX);
+    i = start + len;
+    if (out != NULL) {
+      if (o + 1 + len > out_len) {
+        return 0;
+      }
+      out[o] = len - 1;
+      memcpy(&out[o + 1], &in[start], len);
+    }
+    o += 1 + len;
+  }
+  return o;
+}
+
+int32_t sl_rle_decode(uint8_t *out, uint16_t out_len, const uint8_t *in,
+                      uint16_t in_len) {
+  uint16_t o = 0;
+  uint16_t i = 0;
+  while (i < in_len) {
+    uint8_t header = in[i++];
+    uint16_t len;
+    if (header & SL_RLE_RUN) {
+      len = (header & ~SL_RLE_RUN) + SL_RLE_RUN_MIN;
+      if (i + 1 > in_len) {
+        return -1;
+      }
+      if (out != NULL) {
+        if (o + len > out_len) {
+          return -1;
+        }
+        memset(&out[o], in[i], len);
+      }
+      i += 1;
+    } else {
+      len = header + 1;
+      if (i + len > in_len) {
+        return -1;
+      }
+      if (out != NULL) {
+        if (o + len > out_len) {
+          return -1;
+        }
+        memmove(&out[o], &in[i], len);
+      }
+      i += len;
+    }
+    o += len;
+  }
+  return o;
 }
 
 // Read as many bytes as possible from UART1
@@ -207,69 +786,221 @@ static uint16_t _read(uint8_t *buf, uint16_t buf_len) {
   return idx;
 }
 
-// Read next frame into `buf`.
+// How long to wait for the FIFO to fill when polling with a timeout
+#define SL_POLL_US 10
+
+// Read next control frame into `buf`, its command goes to `cmd`.
 // At most `buf_len` bytes
-// Blocks until complete frame has been received.
-static uint16_t sl_next_frame(uint8_t *buf, uint16_t buf_len) {
+// Blocks until complete frame has been received. Returns -1 if there was no
+// frame for `timeout_us` or if the next one is corrupt. Other frames are
+// ignored.
+static int32_t sl_next_frame_timeout(uint8_t *cmd, uint8_t *buf,
+                                     uint16_t buf_len, uint32_t timeout_us) {
   uint8_t frame[700];
-  uint16_t frame_len = 0;
+  struct sl_parser parser;
   uint8_t buf_rd[32];
   uint16_t buf_rd_len = 0;
+  uint32_t idle_us = 0;
+
+  sl_parser_init(&parser, &frame[0], sizeof(frame), NULL);
 
   while (true) {
-    buf_rd_len = _read(&buf_rd[0], sizeof(buf_rd));
+    uint16_t read = _read(&buf_rd[buf_rd_len], sizeof(buf_rd) - buf_rd_len);
+    buf_rd_len += read;
+    if (read == 0) {
+      if (idle_us >= timeout_us) {
+        return -1;
+      }
+      arch_asm_delay_us(SL_POLL_US);
+      idle_us += SL_POLL_US;
+    }
     if (buf_rd_len > 0) {
       // LOG("read %d bytes\n", buf_rd_len);
-      enum sl_status res = serial_link_parse_packet(
-          &buf_rd[0], &buf_rd_len, &frame[0], &frame_len, sizeof(frame));
+      enum sl_status res =
+          serial_link_parse_packet(&parser, &buf_rd[0], &buf_rd_len);
 
       switch (res) {
       case SL_PACKET_TYPE_CTRL_DATA: {
-        uint16_t len = MIN(buf_len, frame_len - 6);
-        memcpy(buf, &frame[4], len);
+        if (sl_parser_payload_len(&parser) == 0) {
+          break;
+        }
+        *cmd = sl_parser_payload(&parser)[0];
+        if (*cmd == SL_CTRL_CMD_COMPRESSED &&
+            sl_parser_payload_len(&parser) >= 2) {
+          // Decode straight out of the frame, skipping both command bytes
+          *cmd = sl_parser_payload(&parser)[1];
+          int32_t len = sl_rle_decode(buf, buf_len,
+                                      sl_parser_payload(&parser) + 2,
+                                      sl_parser_payload_len(&parser) - 2);
+          return len;
+        }
+        // Skip the command byte
+        uint16_t len = MIN(buf_len, sl_parser_payload_len(&parser) - 1);
+        memcpy(buf, sl_parser_payload(&parser) + 1, len);
         return len;
       } break;
       case SL_NONE:
         break;
+      case SL_ERR:
+        return -1;
       default:
-        ASSERT_ERROR(false);
+        break;
       }
     }
   }
   return 0;
 }
 
+// Largest payload of sl_write(), after the command byte
+#define SL_WRITE_PAYLOAD_MAX 8
+
 // Blocking write is meant for small payloads
-static void sl_write(uint8_t cmd, uint8_t *payload, uint16_t payload_len) {
-  uint8_t buf[10] = {0};
-  uint8_t buf_out[20] = {0};
-
-  ASSERT_ERROR(payload_len < sizeof(buf) - 1);
-  buf[0] = cmd;
-  memcpy(&buf[1], payload, payload_len);
-  uint16_t len = serial_link_format(&buf_out[0], sizeof(buf_out),
-                                    SL_PT_CTRL_DATA, &buf[0], 1 + payload_len);
+static void sl_write(uint8_t cmd, const uint8_t *payload, uint16_t payload_len) {
+  uint8_t buf_out[SERIAL_LINK_FRAME_LEN_MAX(1 + SL_WRITE_PAYLOAD_MAX)] = {0};
+
+  ASSERT_ERROR(payload_len <= SL_WRITE_PAYLOAD_MAX);
+  const struct sl_iov iov[] = {
+      {.data = &cmd, .len = 1},
+      {.data = payload, .len = payload_len},
+  };
+  uint16_t len = serial_link_format_iov(&buf_out[0], sizeof(buf_out),
+                                        SL_PT_CTRL_DATA, &iov[0], 2);
   uart_send(UART1, &buf_out[0], len, UART_OP_BLOCKING);
 }
 
+// How long to wait for the answer to a load before asking again. The MCU may
+// have to read it from its flash first.
+#define SL_LOAD_TIMEOUT_US 500000
+
+// Asks the MCU for `cmd` until it answers, into `buf`. Answers to other
+// commands, such as a late one to an earlier load, are skipped.
+static uint16_t sl_load(uint8_t cmd, uint8_t *buf, uint16_t buf_len) {
+  while (true) {
+    sl_write(cmd, NULL, 0);
+    uint8_t answer;
+    int32_t len;
+    do {
+      len = sl_next_frame_timeout(&answer, buf, buf_len, SL_LOAD_TIMEOUT_US);
+    } while (len >= 0 && answer != cmd);
+    if (len >= 0) {
+      return len;
+    }
+    LOG("no answer to %d, asking again\n", cmd);
+  }
+}
+
 uint16_t sl_bond_db_load(uint8_t *bdb, uint16_t bdb_len) {
-  sl_write(SL_CTRL_CMD_BOND_DB_GET, NULL, 0);
-  return sl_next_frame(bdb, bdb_len);
+  return sl_load(SL_CTRL_CMD_BOND_DB_GET, bdb, bdb_len);
 }
 
 uint16_t sl_identity_address_load(uint8_t *addr, uint16_t addr_len) {
-  sl_write(SL_CTRL_CMD_IDENTITY_ADDRESS, NULL, 0);
-  return sl_next_frame(addr, addr_len);
+  return sl_load(SL_CTRL_CMD_IDENTITY_ADDRESS, addr, addr_len);
 }
 
 uint16_t sl_irk_load(uint8_t *irk, uint16_t irk_len) {
-  sl_write(SL_CTRL_CMD_IRK, NULL, 0);
-  return sl_next_frame(irk, irk_len);
+  return sl_load(SL_CTRL_CMD_IRK, irk, irk_len);
 }
 
 uint16_t sl_device_name_load(uint8_t *device_name, uint16_t device_name_len) {
-  sl_write(SL_CTRL_CMD_DEVICE_NAME, NULL, 0);
-  return sl_next_frame(device_name, device_name_len);
+  return sl_load(SL_CTRL_CMD_DEVICE_NAME, device_name, device_name_len);
+}
+
+struct sl_caps sl_peer_caps = SL_CAPS_LEGACY;
+
+// Compressed control frames may be sent, see sl_hello()
+static bool sl_compression = false;
+
+bool serial_link_compression(void) { return sl_compression; }
+
+// MCU firmware that doesn't know SL_CTRL_CMD_HELLO doesn't answer it
+#define SL_HELLO_TIMEOUT_US 100000
+
+void sl_hello(const struct sl_caps *caps) {
+  const uint8_t hello[] = {
+      caps->version, caps->frame_max & 0xff, caps->frame_max >> 8,
+      caps->window,  caps->framings,         caps->baud_rates,
+      caps->compressions,
+  };
+  sl_write(SL_CTRL_CMD_HELLO, &hello[0], sizeof(hello));
+
+  uint8_t cmd;
+  uint8_t peer[sizeof(hello)];
+  int32_t len =
+      sl_next_frame_timeout(&cmd, &peer[0], sizeof(peer), SL_HELLO_TIMEOUT_US);
+  if (len < 1 || cmd != SL_CTRL_CMD_HELLO) {
+    return;
+  }
+  sl_peer_caps.version = peer[0];
+  if (len >= 3) {
+    sl_peer_caps.frame_max = peer[1] | peer[2] << 8;
+  }
+  if (len >= 4) {
+    sl_peer_caps.window = peer[3];
+  }
+  if (len >= 5) {
+    sl_peer_caps.framings = peer[4];
+  }
+  if (len >= 6) {
+    sl_peer_caps.baud_rates = peer[5];
+  }
+  if (len >= 7) {
+    sl_peer_caps.compressions = peer[6];
+  }
+
+  if (caps->framings & sl_peer_caps.framings &
+      SL_FRAMING_MASK(SL_FRAMING_COBS)) {
+    serial_link_set_framing(SL_FRAMING_COBS);
+  }
+  sl_compression = caps->compressions & sl_peer_caps.compressions &
+                   SL_COMPRESSION_MASK(SL_COMPRESSION_RLE);
+}
+
+static const UART_BAUDRATE sl_baud_rates[] = {
+    [SL_BAUD_RATE_115200] = UART_BAUDRATE_115200,
+    [SL_BAUD_RATE_460800] = UART_BAUDRATE_460800,
+    [SL_BAUD_RATE_921600] = UART_BAUDRATE_921600,
+    [SL_BAUD_RATE_1000000] = UART_BAUDRATE_1000000,
+};
+
+// Returns true if the MCU answered the request for `rate`
+static bool sl_baud_rate_request(uint8_t rate) {
+  sl_write(SL_CTRL_CMD_BAUD_RATE, &rate, 1);
+  uint8_t cmd;
+  uint8_t answer;
+  int32_t len =
+      sl_next_frame_timeout(&cmd, &answer, 1, SL_BAUD_RATE_TIMEOUT_US);
+  return len == 1 && cmd == SL_CTRL_CMD_BAUD_RATE && answer == rate;
+}
+
+static uint8_t sl_baud_rate = SL_BAUD_RATE_115200;
+
+enum sl_baud_rate serial_link_baud_rate(void) { return sl_baud_rate; }
+
+static void sl_baud_rate_set(uint8_t rate) {
+  // Bytes still in the FIFO would go out at the new rate
+  uart_wait_tx_finish(UART1);
+  uart_baudrate_setf(UART1, sl_baud_rates[rate]);
+  sl_baud_rate = rate;
+}
+
+void sl_baud_rate_upgrade(const struct sl_caps *caps) {
+  uint8_t common = caps->baud_rates & sl_peer_caps.baud_rates;
+  uint8_t rate = SL_BAUD_RATE_1000000;
+  while (rate > SL_BAUD_RATE_115200 && !(common & SL_BAUD_RATE_MASK(rate))) {
+    rate--;
+  }
+  if (rate == SL_BAUD_RATE_115200) {
+    return;
+  }
+  if (sl_baud_rate_request(rate)) {
+    sl_baud_rate_set(rate);
+    if (sl_baud_rate_request(rate)) {
+      return;
+    }
+    sl_baud_rate_set(SL_BAUD_RATE_115200);
+  }
+  // The MCU may have switched even if its answer got lost
+  arch_asm_delay_us(2 * SL_BAUD_RATE_TIMEOUT_US);
 }
 
 /// sl_init registers a simpler rx callback that only handles the objects we
@@ -15,6 +15,11 @@
 #ifndef SERIAL_LINK_H
 #define SERIAL_LINK_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ring.h"
+
 // Control commands
 #define SL_CTRL_CMD_DEVICE_NAME 1
 #define SL_CTRL_CMD_BOND_DB_GET 2
@@ -29,6 +34,12 @@
 #define SL_CTRL_CMD_TK_CONFIRM 11
 #define SL_CTRL_CMD_BLE_ENABLED 12
 #define SL_CTRL_CMD_BLE_PWR_LEVEL 13
+#define SL_CTRL_CMD_LINK_WINDOW 14
+#define SL_CTRL_CMD_HELLO 15
+#define SL_CTRL_CMD_BAUD_RATE 16
+#define SL_CTRL_CMD_LINK_STATS 17
+#define SL_CTRL_CMD_CREDIT 18
+#define SL_CTRL_CMD_COMPRESSED 19
 #define SL_CTRL_CMD_DEBUG_STR 254
 
 #define BLE_STATUS_ADVERTISING 0
@@ -42,13 +53,222 @@ enum packet_type {
   SL_PT_BLE_DATA = 0b00111100,
   SL_PT_CTRL_DATA = 0b10110100,
   SL_PT_PING = 0b01001011,
+  // Sequenced variants of the packets above, see sl_link.h. ACK and NAK are
+  // always sequenced.
+  SL_PT_SEQ_BLE_DATA = 0b01101001,
+  SL_PT_SEQ_CTRL_DATA = 0b01111000,
+  SL_PT_SEQ_PING = 0b10000111,
+};
+
+/// Payload of SL_PT_PING. A request is answered with a response that repeats
+/// it and adds when the request was received and when the response was sent.
+/// Times are little endian microseconds of the clock of the side that took
+/// them, so the sender of the request can tell the round trip time and the
+/// offset between the clocks.
+enum sl_ping_kind {
+  SL_PING_REQUEST,
+  SL_PING_RESPONSE,
+};
+
+// Kind, id and the time the request was sent
+#define SL_PING_REQUEST_LEN 6
+// The request, the time it was received and the time the response was sent
+#define SL_PING_RESPONSE_LEN 14
+
+/// Sequenced packets have a sequence number and a cumulative acknowledgement
+/// between the length and the payload
+static inline bool sl_packet_type_is_seq(uint8_t type) {
+  switch (type) {
+  case SL_PT_ACK:
+  case SL_PT_NAK:
+  case SL_PT_SEQ_BLE_DATA:
+  case SL_PT_SEQ_CTRL_DATA:
+  case SL_PT_SEQ_PING:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/// Sequenced variant of a packet type
+static inline uint8_t sl_packet_type_seq(uint8_t type) {
+  switch (type) {
+  case SL_PT_BLE_DATA:
+    return SL_PT_SEQ_BLE_DATA;
+  case SL_PT_CTRL_DATA:
+    return SL_PT_SEQ_CTRL_DATA;
+  case SL_PT_PING:
+    return SL_PT_SEQ_PING;
+  default:
+    return type;
+  }
+}
+
+/// Plain variant of a packet type
+static inline uint8_t sl_packet_type_plain(uint8_t type) {
+  switch (type) {
+  case SL_PT_SEQ_BLE_DATA:
+    return SL_PT_BLE_DATA;
+  case SL_PT_SEQ_CTRL_DATA:
+    return SL_PT_CTRL_DATA;
+  case SL_PT_SEQ_PING:
+    return SL_PT_PING;
+  default:
+    return type;
+  }
+}
+
+/// Framing of the frames on the wire
+enum sl_framing {
+  // SOF delimited, SOF, ESCAPE and STX within the frame are escaped. Up to
+  // twice the size of the frame.
+  SL_FRAMING_ESCAPE,
+  // Consistent overhead byte stuffing, delimited by zeros. One byte of
+  // overhead per 254 bytes of the frame. STX isn't escaped, so a reset of the
+  // chip is only recognized between frames.
+  SL_FRAMING_COBS,
+};
+
+/// Bit of a framing in struct sl_caps
+#define SL_FRAMING_MASK(framing) (1 << (framing))
+
+/// Sets the framing of formatted frames and of parsers initialized afterwards
+void serial_link_set_framing(enum sl_framing framing);
+enum sl_framing serial_link_framing(void);
+
+/// Baud rates of the UART
+enum sl_baud_rate {
+  // Rate at boot, the only one of legacy firmware
+  SL_BAUD_RATE_115200,
+  SL_BAUD_RATE_460800,
+  SL_BAUD_RATE_921600,
+  SL_BAUD_RATE_1000000,
 };
 
+/// Bit of a baud rate in struct sl_caps
+#define SL_BAUD_RATE_MASK(rate) (1 << (rate))
+
+/// How long both sides wait for a frame at a new baud rate before falling back.
+/// The MCU answers right away, it doesn't need to load anything.
+#define SL_BAUD_RATE_TIMEOUT_US 10000
+
+/// Baud rate in use, see sl_baud_rate_upgrade()
+enum sl_baud_rate serial_link_baud_rate(void);
+
+/// Compression of control payloads
+///
+/// A compressed control frame carries SL_CTRL_CMD_COMPRESSED, the original
+/// command and the encoded arguments of the original command. Either side only
+/// sends them if both support the compression, and only if it makes the frame
+/// shorter.
+enum sl_compression {
+  // Run-length encoding, see sl_rle_encode()
+  SL_COMPRESSION_RLE,
+};
+
+/// Bit of a compression in struct sl_caps
+#define SL_COMPRESSION_MASK(compression) (1 << (compression))
+
+/// True if compressed control frames may be sent, see sl_hello()
+bool serial_link_compression(void);
+
+/// Run-length encodes `in` into `out`. A header byte with the top bit set is
+/// followed by one byte that repeats (header & 0x7f) + 3 times, otherwise it is
+/// followed by header + 1 literal bytes. Worst case one byte of overhead per
+/// 128 bytes.
+///
+/// Returns the encoded length, 0 if it doesn't fit into `out_len`. With `out`
+/// NULL only the length is computed.
+uint16_t sl_rle_encode(uint8_t *out, uint16_t out_len, const uint8_t *in,
+                       uint16_t in_len);
+
+/// Decodes what sl_rle_encode() produced into `out`. Needs no memory besides
+/// `out`, so it decodes straight out of the receive buffer.
+///
+/// Returns the decoded length, -1 if `in` is malformed or doesn't fit into
+/// `out_len`. With `out` NULL only the length is computed.
+int32_t sl_rle_decode(uint8_t *out, uint16_t out_len, const uint8_t *in,
+                      uint16_t in_len);
+
+/// Upper bound of the formatted length of a packet, if every byte needs to be
+/// escaped. Also holds for COBS.
+#define SERIAL_LINK_FRAME_LEN_MAX(payload_len) (2 + 2 * (5 + (payload_len) + 2))
+
+/// Upper bound of the formatted length of a packet in the current framing
+uint16_t serial_link_frame_len_max(uint16_t payload_len);
+
+/// Tighter bound than serial_link_frame_len_max() that looks at the payload,
+/// only the header and crc are assumed to be escaped
+uint16_t serial_link_frame_len_bound(const uint8_t *payload,
+                                     uint16_t payload_len);
+
 /// Formats a packet into buf for sending over serial
 /// Returns number of bytes formatted
 uint16_t serial_link_format(uint8_t *buf, uint16_t buf_len, uint8_t typ,
                             const uint8_t *payload, uint16_t payload_len);
 
+/// A segment of a payload
+struct sl_iov {
+  const uint8_t *data;
+  uint16_t len;
+};
+
+/// Formats a packet whose payload is the concatenation of `iov_cnt` segments,
+/// for example a command byte and its data, without copying them together
+/// first.
+/// Returns number of bytes formatted
+uint16_t serial_link_format_iov(uint8_t *buf, uint16_t buf_len, uint8_t typ,
+                                const struct sl_iov *iov, uint8_t iov_cnt);
+
+/// Formats a sequenced packet, `typ` is the plain packet type. See sl_link.h.
+/// Returns number of bytes formatted
+uint16_t serial_link_format_seq(uint8_t *buf, uint16_t buf_len, uint8_t typ,
+                                uint8_t seq, uint8_t ack,
+                                const struct sl_iov *iov, uint8_t iov_cnt);
+
+/// A frame that is formatted piece by piece, for sending it without a buffer
+/// that holds all of it. The payload is read in place and has to stay valid
+/// until sl_stream_done(). Initialize with sl_stream_init() or
+/// sl_stream_init_seq(), a zeroed sl_stream is done.
+struct sl_stream {
+  const uint8_t *payload;
+  uint16_t payload_len;
+  // Index of the next unescaped byte of the frame, including header and crc
+  uint16_t idx;
+  // Running crc of the frame, stored as 16 bit to keep the struct small. With
+  // COBS it is computed up front, a code byte can depend on it.
+  uint16_t crc;
+  // Type, little endian payload length and for sequenced packets the sequence
+  // number and acknowledgement
+  uint8_t header[5];
+  uint8_t header_len;
+  uint8_t framing;
+  // Second byte of an escape sequence, 0 if there is none
+  uint8_t escaped;
+  // COBS bytes left in the current block, and if a zero follows them or if it
+  // is the last block
+  uint8_t cobs_left;
+  bool cobs_zero;
+  bool cobs_last;
+  uint8_t state;
+};
+
+/// Starts a frame in the current framing, like serial_link_format()
+void sl_stream_init(struct sl_stream *s, uint8_t typ, const uint8_t *payload,
+                    uint16_t payload_len);
+
+/// Starts a sequenced frame, like serial_link_format_seq()
+void sl_stream_init_seq(struct sl_stream *s, uint8_t typ, uint8_t seq,
+                        uint8_t ack, const uint8_t *payload,
+                        uint16_t payload_len);
+
+/// Formats the next bytes of the frame into buf, as many as fit.
+/// Returns number of bytes formatted, 0 once the frame is done
+uint16_t sl_stream_read(struct sl_stream *s, uint8_t *buf, uint16_t buf_len);
+
+/// True once every byte of the frame has been read
+bool sl_stream_done(const struct sl_stream *s);
+
 // Result type for serial_link_parse_packet
 enum sl_status {
   SL_NONE,
@@ -60,23 +280,167 @@ enum sl_status {
   SL_PACKET_TYPE_PING,
 };
 
-/// Will read out the next frame from the stream. Returns true if there is
-/// a complete frame in the output, or false in case it needs more bytes.
+enum serial_link_state {
+  SERIAL_LINK_WAIT,
+  SERIAL_LINK_ACCEPT,
+  SERIAL_LINK_ESCAPE,
+  // A frame was returned, the next call starts a new one
+  SERIAL_LINK_DONE,
+};
+
+struct sl_parser;
+
+/// Called once the header of a frame with a payload has been received, see
+/// sl_parser_type() and sl_parser_payload_len(). Returns where the payload
+/// should be unescaped to, or NULL to drop the frame. The destination must fit
+/// sl_parser_payload_len() bytes.
+///
+/// Once a destination has been returned the frame always completes with either
+/// a packet type or SL_ERR, so the destination can be released then.
+typedef uint8_t *(*sl_payload_alloc_t)(struct sl_parser *p);
+
+/// State of one incoming stream. Owned by the caller so that several streams
+/// can be parsed independently. Initialize with sl_parser_init().
+///
+/// The payload of a complete frame stays valid until the next parse call on
+/// the same parser.
+struct sl_parser {
+  // Where the payload of the current frame is unescaped to
+  uint8_t *payload;
+  sl_payload_alloc_t alloc;
+  uint8_t *frame;
+  uint16_t frame_cap;
+  // Number of unescaped bytes of the current frame, including header and crc
+  uint16_t frame_len;
+  // Running crc of the frame, stored as 16 bit to keep the struct small
+  uint16_t crc;
+  // Type, little endian payload length and for sequenced packets the sequence
+  // number and acknowledgement
+  uint8_t header[5];
+  uint8_t header_len;
+  uint8_t framing;
+  // COBS bytes left in the current block and its code byte
+  uint8_t cobs_left;
+  uint8_t cobs_code;
+  uint8_t state;
+};
+
+/// frame - Buffer to unescape payloads into, can be NULL if `alloc` is given
+/// frame_cap - capacity of `frame`. how many bytes long the buffer is
+/// alloc - Optional, provides a destination for each payload instead of
+///         `frame`, for example a freshly allocated kernel message.
+void sl_parser_init(struct sl_parser *p, uint8_t *frame, uint16_t frame_cap,
+                    sl_payload_alloc_t alloc);
+
+/// Packet type of the current frame
+static inline uint8_t sl_parser_type(const struct sl_parser *p) {
+  return p->header[0];
+}
+
+/// Sequence number of the current frame, if it is sequenced
+static inline uint8_t sl_parser_seq(const struct sl_parser *p) {
+  return p->header[3];
+}
+
+/// Acknowledgement of the current frame, if it is sequenced
+static inline uint8_t sl_parser_ack(const struct sl_parser *p) {
+  return p->header[4];
+}
+
+/// Payload of the last complete frame
+static inline const uint8_t *sl_parser_payload(const struct sl_parser *p) {
+  return p->payload;
+}
+
+/// Length of the payload of the current frame, as given in its header
+static inline uint16_t sl_parser_payload_len(const struct sl_parser *p) {
+  return p->header[1] | p->header[2] << 8;
+}
+
+/// Will read out the next frame from the stream. Returns SL_NONE in case it
+/// needs more bytes.
+///
+/// p - Parser state of the stream
+/// rx - Ring buffer to read from. Only the bytes up to the end of the frame
+///      are consumed, any unread bytes are left for the next call.
+///
+/// if it returns SL_ERR send a NAK back
+///
+enum sl_status serial_link_parse_packet_ring(struct sl_parser *p,
+                                             struct ring *rx);
+
+/// Same as serial_link_parse_packet_ring but reads from a linear buffer.
 ///
 /// buf - Buffer to read from, there might be unread bytes in case there was
 ///       more than one frame in the buffer
 /// buf_len - length of content in buffer. Will be updated in case there are
-///           unread bytes
-/// frame - Buffer to write to
-/// frame_len - how many bytes were written to `frame` buffer
-/// frame_cap - capacity of `frame`. how many bytes long the buffer is
+///           unread bytes, which are moved to the beginning of `buf`.
 ///
-/// if it returns PACKET_TYPE_ERR send a NAK back
+/// Moving the unread bytes makes this unsuitable for interrupt context, it is
+/// meant for the blocking reads during boot.
+enum sl_status serial_link_parse_packet(struct sl_parser *p, uint8_t *buf,
+                                        uint16_t *buf_len);
+
+/// Version of the protocol on the serial link
 ///
-enum sl_status serial_link_parse_packet(uint8_t *buf, uint16_t *buf_len,
-                                        uint8_t *frame, uint16_t *frame_len,
-                                        uint16_t frame_cap);
+/// 1 - HELLO, PINGs with timestamps
+/// 2 - Credits, see SL_CTRL_CMD_CREDIT in uart_task.h
+#define SL_PROTOCOL_VERSION 2
 
+/// Capabilities exchanged in SL_CTRL_CMD_HELLO
+///
+/// On the wire they follow the command byte in this order, multi-byte fields
+/// little endian. Fields are only ever appended, those missing from the HELLO
+/// of an older peer keep their SL_CAPS_LEGACY value and those unknown to an
+/// older peer are ignored by it.
+struct sl_caps {
+  uint8_t version;
+  // Largest payload accepted at runtime
+  uint16_t frame_max;
+  // Most sequenced frames that can be unacknowledged, see sl_link.h
+  uint8_t window;
+  // SL_FRAMING_MASK() of the supported framings
+  uint8_t framings;
+  // SL_BAUD_RATE_MASK() of the supported baud rates
+  uint8_t baud_rates;
+  // SL_COMPRESSION_MASK() of the supported compressions
+  uint8_t compressions;
+};
+
+/// Capabilities of firmware from before the HELLO, which doesn't answer it
+#define SL_CAPS_LEGACY                                                         \
+  {.version = 0,                                                               \
+   .frame_max = 64,                                                            \
+   .window = 0,                                                                \
+   .framings = SL_FRAMING_MASK(SL_FRAMING_ESCAPE),                             \
+   .baud_rates = SL_BAUD_RATE_MASK(SL_BAUD_RATE_115200),                       \
+   .compressions = 0}
+
+/// Capabilities of the MCU, SL_CAPS_LEGACY until sl_hello() got an answer
+extern struct sl_caps sl_peer_caps;
+
+// Blocking exchange of capabilities with the MCU, to be done before anything
+// else is loaded. Both sides switch to the best framing they have in common
+// right after the MCU has answered, and compress control frames from then on
+// if they both support it.
+void sl_hello(const struct sl_caps *caps);
+// Blocking switch to the fastest baud rate both sides support, after
+// sl_hello().
+//
+// The chip asks with SL_CTRL_CMD_BAUD_RATE and the rate, the MCU answers with
+// the same command and switches once its answer is sent, the chip once it has
+// received it. The chip then asks again at the new rate and the MCU answers
+// again, after which the chip goes on loading.
+//
+// Both sides fall back to 115200 if the next frame they expect at the new rate
+// fails its CRC or doesn't arrive within SL_BAUD_RATE_TIMEOUT_US. For the MCU
+// that is the second request and then the first load. A chip that falls back,
+// or didn't get an answer to its first request, stays silent for twice as
+// long, so that the MCU has fallen back as well before it goes on loading.
+void sl_baud_rate_upgrade(const struct sl_caps *caps);
+// The loads below ask again until the MCU answers, whenever an answer doesn't
+// arrive in time or is corrupt.
+//
 // Blocking load of bond_db
 uint16_t sl_bond_db_load(uint8_t *bdb, uint16_t bdb_len);
 // Blocking load of IRK
@@ -0,0 +1,202 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SL_LINK_H
+#define SL_LINK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/// Sliding window on top of the serial link
+///
+/// Once the MCU enables the window with SL_CTRL_CMD_LINK_WINDOW both sides send
+/// sequenced packets. Their header carries the sequence number of the packet
+/// and, piggybacked, the sequence number the sender expects to receive next.
+/// That acknowledges every packet before it. ACK and NAK carry the same header
+/// with an empty payload and don't take a sequence number.
+///
+/// Packets that arrive ahead of a missing one are kept by the receiver, as long
+/// as they are within the window. A NAK asks for the single packet in its
+/// acknowledgement to be sent again. Packets that aren't acknowledged in time
+/// are all sent again.
+///
+/// Sequence numbers are 8 bit and wrap around, the window is much smaller than
+/// half the sequence space so old and new packets can be told apart.
+
+#define SL_LINK_WINDOW_MAX 8
+
+struct sl_link {
+  // Number of packets that may be unacknowledged, 0 if disabled
+  uint8_t window;
+  // Sequence number of the oldest unacknowledged packet
+  uint8_t tx_unacked;
+  // Sequence number of the next packet to transmit for the first time
+  uint8_t tx_sent;
+  // Sequence number of the next packet put into the window
+  uint8_t tx_next;
+  // Packets to send again, bit `seq % SL_LINK_WINDOW_MAX`
+  uint8_t tx_resend;
+  // Sequence number expected from the peer
+  uint8_t rx_expected;
+  // The peer should be told about rx_expected
+  bool ack_pending;
+  // A packet was lost or corrupted, rx_expected should be sent again
+  bool nak_pending;
+  // A NAK was sent for rx_expected, there is only one per lost packet
+  bool nak_sent;
+};
+
+enum sl_link_rx {
+  // The packet is the next in sequence
+  SL_LINK_RX_ACCEPT,
+  // The packet was received before
+  SL_LINK_RX_DUPLICATE,
+  // Packets before this one are missing, it is within the window and can be
+  // kept until they arrive
+  SL_LINK_RX_AHEAD,
+  // The packet is beyond the window
+  SL_LINK_RX_INVALID,
+};
+
+static inline void sl_link_init(struct sl_link *l, uint8_t window) {
+  l->window = window;
+  l->tx_unacked = 0;
+  l->tx_sent = 0;
+  l->tx_next = 0;
+  l->tx_resend = 0;
+  l->rx_expected = 0;
+  l->ack_pending = false;
+  l->nak_pending = false;
+  l->nak_sent = false;
+}
+
+static inline bool sl_link_enabled(const struct sl_link *l) {
+  return l->window > 0;
+}
+
+static inline uint8_t sl_link_slot(uint8_t seq) {
+  return seq % SL_LINK_WINDOW_MAX;
+}
+
+/// Number of packets in the window, sent or not
+static inline uint8_t sl_link_in_window(const struct sl_link *l) {
+  return (uint8_t)(l->tx_next - l->tx_unacked);
+}
+
+/// Number of packets sent and not yet acknowledged
+static inline uint8_t sl_link_in_flight(const struct sl_link *l) {
+  return (uint8_t)(l->tx_sent - l->tx_unacked);
+}
+
+/// True if another packet fits in the window
+static inline bool sl_link_tx_ready(const struct sl_link *l) {
+  return sl_link_in_window(l) < l->window;
+}
+
+/// Puts a new packet into the window, returns its sequence number
+static inline uint8_t sl_link_tx_push(struct sl_link *l) {
+  return l->tx_next++;
+}
+
+/// True if there is a packet in the window that hasn't been transmitted
+static inline bool sl_link_tx_pending(const struct sl_link *l) {
+  return l->tx_sent != l->tx_next;
+}
+
+/// Marks the next packet as transmitted, returns its sequence number
+static inline uint8_t sl_link_tx_next(struct sl_link *l) {
+  return l->tx_sent++;
+}
+
+/// Applies an acknowledgement from the peer. Returns how many packets it
+/// acknowledged for the first time, stale or bogus ones acknowledge nothing.
+static inline uint8_t sl_link_tx_ack(struct sl_link *l, uint8_t ack) {
+  uint8_t acked = (uint8_t)(ack - l->tx_unacked);
+  if (acked > sl_link_in_flight(l)) {
+    return 0;
+  }
+  for (uint8_t i = 0; i < acked; i++) {
+    l->tx_resend &= ~(1 << sl_link_slot(l->tx_unacked++));
+  }
+  return acked;
+}
+
+/// Applies a NAK from the peer, which acknowledges everything before the
+/// packet it asks for. Returns false if that packet isn't in flight.
+static inline bool sl_link_tx_nak(struct sl_link *l, uint8_t ack) {
+  sl_link_tx_ack(l, ack);
+  if ((uint8_t)(ack - l->tx_unacked) >= sl_link_in_flight(l)) {
+    return false;
+  }
+  l->tx_resend |= 1 << sl_link_slot(ack);
+  return true;
+}
+
+/// Marks every packet in flight to be sent again, after a timeout
+static inline void sl_link_tx_resend_all(struct sl_link *l) {
+  for (uint8_t seq = l->tx_unacked; seq != l->tx_sent; seq++) {
+    l->tx_resend |= 1 << sl_link_slot(seq);
+  }
+}
+
+/// Takes the oldest packet that has to be sent again. Returns false if there
+/// is none.
+static inline bool sl_link_tx_resend_next(struct sl_link *l, uint8_t *seq) {
+  for (uint8_t s = l->tx_unacked; s != l->tx_sent; s++) {
+    if (l->tx_resend & (1 << sl_link_slot(s))) {
+      l->tx_resend &= ~(1 << sl_link_slot(s));
+      *seq = s;
+      return true;
+    }
+  }
+  return false;
+}
+
+/// A packet was lost or corrupted
+static inline void sl_link_rx_error(struct sl_link *l) {
+  if (!l->nak_sent) {
+    l->nak_pending = true;
+    l->nak_sent = true;
+  }
+}
+
+/// The packet with sequence number rx_expected is delivered
+static inline void sl_link_rx_advance(struct sl_link *l) {
+  l->rx_expected++;
+  l->ack_pending = true;
+  l->nak_pending = false;
+  l->nak_sent = false;
+}
+
+/// Checks the sequence number of a received packet. Accepted packets are
+/// delivered right away, those ahead once the ones before them are.
+static inline enum sl_link_rx sl_link_rx_seq(struct sl_link *l, uint8_t seq) {
+  uint8_t ahead = (uint8_t)(seq - l->rx_expected);
+  if (ahead == 0) {
+    sl_link_rx_advance(l);
+    return SL_LINK_RX_ACCEPT;
+  }
+  if (ahead >= 0x80) {
+    // Our acknowledgement was lost, repeat it
+    l->ack_pending = true;
+    return SL_LINK_RX_DUPLICATE;
+  }
+  if (ahead >= l->window) {
+    return SL_LINK_RX_INVALID;
+  }
+  sl_link_rx_error(l);
+  return SL_LINK_RX_AHEAD;
+}
+
+#endif
@@ -13,30 +13,240 @@
 // limitations under the License.
 
 #include <app_easy_security.h>
+#include <co_list.h>
 #include <crc.h>
 #include <custs1_task.h>
 #include <da1458x_scatter_config.h>
 #include <ke_msg.h>
 #include <ke_task.h>
+#include <lld_evt.h>
 #include <prf.h>
 #include <rf_531.h>
 #include <uart.h>
 
 #include "debug.h"
+#include "ring.h"
 #include "serial_link.h"
+#include "sl_link.h"
 #include "uart_task.h"
 #include "user_app.h"
 #include "user_custs1_def.h"
 #include "util.h"
 
+// uart_task.h picks the defaults of UART_RX_DMA and UART_TX_DMA
+#if UART_RX_DMA || UART_TX_DMA
+#include <dma.h>
+#endif
+#if UART_RX_DMA
+#include <ke_mem.h>
+#endif
+
 // Where the Kernel stores some state about our task
 ke_state_t uart_state[UART_COUNT_MAX] = {0};
 
+#if UART_TX_STREAM
+// Chunk of tx_stream being sent, see uart_task_tx_stream_fill
+static uint8_t tx_chunk[UART_TX_STREAM_CHUNK];
+// The frame being escaped by the TX interrupt
+static struct sl_stream tx_stream = {0};
+// Without the link layer, the message being sent and where its next frame
+// starts. Released once all of it has been escaped.
+static struct uart_tx_req const *tx_msg = NULL;
+static uint16_t tx_msg_offset = 0;
+// With the link layer, the frames the TX interrupt escapes one after the
+// other: the frame in tx_stream is tx_job_seq - 1, unless it is done
+static uint8_t tx_job_seq = 0;
+static uint8_t tx_job_end = 0;
+#else
 // UART out buffer
 // bond_db is 644 long
 #define UART_TX_BUF_LEN 700
 static uint8_t tx_buf[UART_TX_BUF_LEN] __SECTION_ZERO("retention_mem_area0");
 
+// A transfer without the link layer, a part of tx_buf
+struct uart_tx_batch {
+  uint16_t offset;
+  uint16_t len;
+  // Bytes of control frames at its start
+  uint16_t ctrl_len;
+};
+// The transfer being sent
+static struct uart_tx_batch tx_sending = {0};
+// The transfer formatted while the one before it is sent, started from the TX
+// interrupt. Empty if len is 0.
+static volatile struct uart_tx_batch tx_next = {0};
+#endif
+// A transfer is being sent
+static volatile bool tx_busy = false;
+
+// With UART_TX_DMA the DMA channel and priority are the TX half of uart_dma_*
+// in user_periph_setup.c
+#if UART_TX_DMA
+#define UART_TX_OP UART_OP_DMA
+#else
+#define UART_TX_OP UART_OP_INTR
+#endif
+// BLE data is formatted in frames of this length, see uart_task_enable
+static uint16_t tx_ble_chunk = UART_BLE_PACKET_LEN;
+
+// Link layer state, see sl_link.h. With UART_TX_STREAM it is shared with the TX
+// interrupt, see uart_task_tx_lock.
+static struct sl_link uart_link = {0};
+// A UART_LINK message has been sent and not yet handled
+static volatile bool link_update_pending = false;
+// Standalone ACK or NAK
+static uint8_t link_ctrl_buf[SERIAL_LINK_FRAME_LEN_MAX(0)];
+
+// The UART interrupt, and with UART_RX_DMA or UART_TX_DMA the DMA interrupt,
+// receive frames and start transfers. Both have the same priority, so they
+// don't preempt each other.
+static void uart_task_irq_disable(void) {
+  NVIC_DisableIRQ(UART_IRQn);
+#if UART_RX_DMA || UART_TX_DMA
+  NVIC_DisableIRQ(DMA_IRQn);
+#endif
+}
+
+static void uart_task_irq_enable(void) {
+#if UART_RX_DMA || UART_TX_DMA
+  NVIC_EnableIRQ(DMA_IRQn);
+#endif
+  NVIC_EnableIRQ(UART_IRQn);
+}
+
+// With UART_TX_STREAM the TX interrupt escapes frames straight out of the
+// queued messages and the window, so TASK_UART only touches those with the
+// interrupts disabled. Otherwise the TX interrupt only starts the transfer in
+// tx_next. TASK_UART then formats with the interrupts enabled and disables them
+// just to hand a transfer over, see uart_task_tx_handover.
+static void uart_task_tx_lock(void) {
+#if UART_TX_STREAM
+  uart_task_irq_disable();
+#endif
+}
+
+static void uart_task_tx_unlock(void) {
+#if UART_TX_STREAM
+  uart_task_irq_enable();
+#endif
+}
+
+// Start a transfer from TASK_UART, which checked that none is being sent, so
+// the TX interrupt can't fire. Without UART_TX_STREAM the interrupts are
+// disabled for uart_send only, as the RX interrupt changes the same interrupt
+// enable register.
+static void uart_task_tx_handover(const uint8_t *data, uint16_t len) {
+#if !UART_TX_STREAM
+  uart_task_irq_disable();
+#endif
+  tx_busy = true;
+  uart_send(UART1, data, len, UART_TX_OP);
+#if !UART_TX_STREAM
+  uart_task_irq_enable();
+#endif
+}
+
+// A frame in the window. Until it is sent it is a chunk of a UART_TX message,
+// which is released once its last chunk has been sent. After that the
+// formatted frame is kept in tx_buf until it is acknowledged, so that it can be
+// sent again without going back to the message. With UART_TX_STREAM there is no
+// tx_buf, the message is released once its last chunk has been acknowledged.
+struct uart_tx_slot {
+  struct uart_tx_req const *req;
+  uint16_t offset;
+  uint16_t len;
+#if !UART_TX_STREAM
+  uint16_t frame_offset;
+  uint16_t frame_len;
+#endif
+  // When the frame was asked for again, see uart_link_stats
+  uint32_t resend_time;
+};
+static struct uart_tx_slot tx_window[SL_LINK_WINDOW_MAX];
+#if UART_TX_STREAM
+// Sequence number of the oldest frame that still holds its message
+static uint8_t tx_released = 0;
+#else
+// End of the newest frame in tx_buf
+static uint16_t tx_store_end = 0;
+#endif
+
+// Queued UART_TX messages of a lane, linked through their kernel message
+// header
+struct uart_tx_queue {
+  struct co_list msgs;
+  // A message that didn't fit in the window and where its next chunk starts
+  struct uart_tx_req const *partial;
+  uint16_t partial_offset;
+};
+static struct uart_tx_queue tx_lanes[UART_TX_LANES];
+
+struct uart_tx_stats uart_tx_stats = {0};
+
+// Frames received ahead of a missing one, with the parse result they completed
+// with. Delivered once the missing ones arrive.
+struct uart_rx_slot {
+  void *msg;
+  uint8_t res;
+};
+static struct uart_rx_slot rx_window[SL_LINK_WINDOW_MAX];
+
+struct uart_link_stats uart_link_stats = {0};
+
+// lld_evt_time_get() is the base time of the BLE core. It counts in units of
+// UART_TIME_RESOLUTION_US with 27 bits and wraps around about every 23 hours,
+// so differences of it are taken modulo its range.
+#define UART_TIME_MASK 0x07ffffff
+#define UART_TIME_DIFF(later, earlier) (((later) - (earlier)) & UART_TIME_MASK)
+// Also for the timestamps of PINGs, which are microseconds modulo 2^32 and
+// jump when lld_evt_time_get() wraps around
+#define UART_TIME_US(time) ((time) * UART_TIME_RESOLUTION_US)
+
+static void uart_task_latency_add(struct uart_latency_stats *s, uint32_t us) {
+  if (s->count == 0 || us < s->min) {
+    s->min = us;
+  }
+  s->max = MAX(s->max, us);
+  s->sum += us;
+  s->count++;
+  uint8_t i = 0;
+  while (i < UART_LATENCY_BUCKETS - 1 && us >= (UART_LATENCY_BUCKET_US << i)) {
+    i++;
+  }
+  s->buckets[i]++;
+}
+
+static enum uart_tx_lane uart_task_tx_lane(uint8_t type) {
+  return type == SL_PT_BLE_DATA ? UART_TX_LANE_BULK : UART_TX_LANE_CTRL;
+}
+
+// Takes the oldest message of a lane, NULL if it is empty
+static struct uart_tx_req const *uart_task_tx_pop(enum uart_tx_lane lane) {
+  struct co_list_hdr *hdr = co_list_pop_front(&tx_lanes[lane].msgs);
+  if (hdr == NULL) {
+    return NULL;
+  }
+  return ke_msg2param((struct ke_msg *)hdr);
+}
+
+static bool uart_task_tx_queued(void) {
+  for (uint8_t lane = 0; lane < UART_TX_LANES; lane++) {
+    if (tx_lanes[lane].partial != NULL ||
+        !co_list_is_empty(&tx_lanes[lane].msgs)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// The first frame of a message is formatted to be sent
+static void uart_task_tx_started(struct uart_tx_req const *req) {
+  uart_tx_stats.messages++;
+  uart_task_latency_add(
+      &uart_tx_stats.lane_delay[uart_task_tx_lane(req->type)],
+      UART_TIME_US(UART_TIME_DIFF(lld_evt_time_get(), req->time)));
+}
+
 // Read as many bytes as possible from UART1
 static uint16_t _read(uint8_t *buf, uint16_t buf_len) {
   uint16_t idx = 0;
@@ -54,77 +264,1151 @@ static uint16_t _read(uint8_t *buf, uint16_t buf_len) {
 
 volatile timer_hnd turn_on_rx_cb_handle = EASY_TIMER_INVALID_TIMER;
 
-// Timer callback to attempt turning on RX interrupts again
+// Turn the RX data interrupt on or off from TASK_UART. The TX interrupt
+// changes the same register.
+static void uart_task_rx_intr_set(UART_BIT enable) {
+  uart_task_irq_disable();
+  uart_rxdata_intr_setf(UART1, enable);
+  uart_task_irq_enable();
+}
+
+static void uart_task_rx_notify(void);
+
+// Timer callback to attempt turning on RX interrupts again. The bytes that were
+// in the ring when the heap ran low are parsed now, the MCU may not send more
+// to set off the interrupt.
 void turn_on_rx_cb(void) {
   turn_on_rx_cb_handle = EASY_TIMER_INVALID_TIMER;
+  uart_task_irq_disable();
   uart_rxdata_intr_setf(UART1, UART_BIT_EN);
+  uart_task_rx_notify();
+  uart_task_irq_enable();
 }
 
-// UART Receive callback
-// As many bytes as possible are read out. If we have a whole frame we forward
-// it over bluetooth or to TASK_UART
-static void uart_task_rx_cb(uint16_t _data_cnt) {
-  static uint8_t buf[64];
-  static uint16_t buf_len = 0;
-  static uint8_t frame[100];
-  static uint16_t frame_len = 0;
+// The kernel message the payload of the current frame is unescaped into
+static void *rx_msg = NULL;
 
-  uint16_t read = _read(&buf[buf_len], sizeof(buf) - buf_len);
-  buf_len += read;
+static void uart_task_rx_dropped(void);
+static void uart_task_link_notify(void);
 
-  ASSERT_ERROR(buf_len <= sizeof(buf));
+// The frame being parsed is dropped by its header. With the link layer that is
+// most likely a corrupted header, so the frame is reported lost for the MCU to
+// send it again right away rather than after its timeout.
+static void uart_task_rx_rejected(void) {
+  if (sl_link_enabled(&uart_link)) {
+    uart_task_tx_lock();
+    sl_link_rx_error(&uart_link);
+    uart_task_link_notify();
+    uart_task_tx_unlock();
+  }
+  uart_task_rx_dropped();
+}
 
-  if (ke_get_mem_usage(KE_MEM_KE_MSG) > ((__SCT_HEAP_MSG_SIZE * 90) / 100)) {
-    // Disable RX interrupts
-    uart_rxdata_intr_setf(UART1, UART_BIT_DIS);
-    LOG("OOM warning\n");
-    if (turn_on_rx_cb_handle == EASY_TIMER_INVALID_TIMER) {
-      turn_on_rx_cb_handle = app_easy_timer(10, turn_on_rx_cb);
-    }
-    return;
+// Allocates the kernel message for a frame as soon as its header is known, so
+// that the payload is unescaped straight into it.
+static uint8_t *uart_task_rx_alloc(struct sl_parser *p) {
+  uint16_t len = sl_parser_payload_len(p);
+  if (len > UART_RX_PAYLOAD_MAX) {
+    uart_task_rx_rejected();
+    return NULL;
+  }
+  uint8_t type = sl_packet_type_plain(sl_parser_type(p));
+  switch (type) {
+  case SL_PT_BLE_DATA: {
+    struct custs1_val_ind_req *req = KE_MSG_ALLOC_DYN(
+        CUSTS1_VAL_IND_REQ, prf_get_task_from_id(TASK_ID_CUSTS1), TASK_APP,
+        custs1_val_ind_req, len);
+    req->handle = SVC1_IDX_TX_VAL;
+    req->length = len;
+    rx_msg = req;
+    return req->value;
+  }
+  case SL_PT_ACK:
+  case SL_PT_NAK:
+  case SL_PT_CTRL_DATA:
+  case SL_PT_PING: {
+    struct uart_rx_req *req = KE_MSG_ALLOC_DYN(
+        UART_RX, KE_BUILD_ID(TASK_UART, 0), TASK_APP, uart_rx_req, len);
+    req->type = type;
+    req->length = len;
+    rx_msg = req;
+    return req->value;
+  }
+  default:
+    uart_task_rx_rejected();
+    return NULL;
   }
+}
+
+// RX state. The UART RX interrupt or the DMA fill the ring and TASK_UART
+// parses it, the ring is the only state they share. The parser and everything
+// after it belong to TASK_UART.
+static uint8_t rx_buf[UART_RX_RING_LEN];
+// Points to the buffer of the DMA once it runs, see uart_task_rx_dma_start
+static struct ring rx = RING_INIT(rx_buf);
+static struct sl_parser rx_parser;
+// A UART_RX_DRAIN message has been sent and not yet handled
+static volatile bool rx_drain_pending = false;
+// The ring was full, the RX interrupt turned itself off until TASK_UART made
+// room
+static volatile bool rx_stalled = false;
+
+// Times of the RX interrupts whose bytes TASK_UART hasn't parsed yet, so that a
+// frame gets the time it arrived rather than the time it was parsed. Another
+// single producer, single consumer ring like rx.
+#define UART_RX_STAMPS 8
+struct uart_rx_stamp {
+  // rx.wr after the interrupt
+  uint16_t wr;
+  // lld_evt_time_get() in the interrupt
+  uint32_t time;
+};
+static struct uart_rx_stamp rx_stamps[UART_RX_STAMPS];
+static volatile uint8_t rx_stamps_rd = 0;
+static volatile uint8_t rx_stamps_wr = 0;
+// Time of the last stamp TASK_UART went past
+static uint32_t rx_stamp_time = 0;
+
+struct uart_rx_stats uart_rx_stats = {0};
 
-  enum sl_status res = serial_link_parse_packet(&buf[0], &buf_len, &frame[0],
-                                                &frame_len, sizeof(frame));
+// Credit state, see UART_RX_CREDITS. Only touched by TASK_UART.
+static bool rx_credits_enabled = false;
+// Number of frames consumed
+static uint16_t rx_consumed = 0;
+// Limit granted to the MCU
+static uint16_t rx_granted = 0;
+// BLE data handed to TASK_CUSTS1 and not yet confirmed
+static uint8_t rx_ble_pending = 0;
+
+static void uart_task_rx_grant(void) {
+  rx_granted = rx_consumed + UART_RX_CREDITS;
+  struct uart_tx_req *req = KE_MSG_ALLOC_DYN(UART_TX, KE_BUILD_ID(TASK_UART, 0),
+                                             TASK_APP, uart_tx_req, 3);
+  req->type = SL_PT_CTRL_DATA;
+  req->length = 3;
+  req->value[0] = SL_CTRL_CMD_CREDIT;
+  req->value[1] = rx_granted & 0xff;
+  req->value[2] = rx_granted >> 8;
+  KE_MSG_SEND(req);
+}
 
+// Frames of the MCU have been consumed. Grants more credits once half of them
+// are used up, so that the MCU doesn't run dry while the grant is on its way.
+static void uart_task_rx_consumed(uint16_t frames) {
+  rx_consumed += frames;
+  if (rx_credits_enabled &&
+      (uint16_t)(rx_consumed + UART_RX_CREDITS - rx_granted) >=
+          UART_RX_CREDITS / 2) {
+    uart_task_rx_grant();
+  }
+}
+
+void uart_task_ble_confirmed(void) {
+  if (rx_ble_pending > 0) {
+    rx_ble_pending--;
+    uart_task_rx_consumed(1);
+  }
+}
+
+void uart_task_ble_disconnected(void) {
+  uart_task_rx_consumed(rx_ble_pending);
+  rx_ble_pending = 0;
+}
+
+// A frame of the MCU was dropped. Without the link layer nobody sends it
+// again, so its credit is returned right away. With it the credit is returned
+// once the frame sent again has been consumed.
+static void uart_task_rx_dropped(void) {
+  if (!sl_link_enabled(&uart_link)) {
+    uart_task_rx_consumed(1);
+  }
+}
+
+// Forward a complete frame over bluetooth or to TASK_UART
+static void uart_task_rx_dispatch(enum sl_status res) {
+  if (res != SL_NONE && rx_msg == NULL) {
+    // Frames without payload have no message. ACK and NAK are handled by the
+    // link layer and don't get here.
+    if (res == SL_ERR) {
+      uart_task_rx_dropped();
+    } else {
+      uart_task_rx_consumed(1);
+    }
+    return;
+  }
   switch (res) {
   case SL_PACKET_TYPE_BLE_DATA: {
-    struct custs1_val_ind_req *req = KE_MSG_ALLOC_DYN(
-        CUSTS1_VAL_IND_REQ, prf_get_task_from_id(TASK_ID_CUSTS1), TASK_APP,
-        custs1_val_ind_req, frame_len - 5);
+    struct custs1_val_ind_req *req = rx_msg;
+    if (app_connection_idx == GAP_INVALID_CONIDX) {
+      // There is nobody to indicate it to, so it won't be confirmed either
+      KE_MSG_FREE(req);
+      uart_task_rx_consumed(1);
+      break;
+    }
     req->conidx = app_connection_idx;
-    req->handle = SVC1_IDX_TX_VAL;
-    req->length = frame_len - 5;
-    memcpy(req->value, &frame[3], frame_len - 5);
+    rx_ble_pending++;
     KE_MSG_SEND(req);
-    frame_len = 0;
   } break;
   case SL_ERR:
-    // TODO: Respond with NAK
+    // The payload may have been partially written to the message
+    KE_MSG_FREE(rx_msg);
+    uart_task_rx_dropped();
+    break;
+  default:
+    KE_MSG_SEND(rx_msg);
     break;
-  default: {
-    struct uart_rx_req *req =
-        KE_MSG_ALLOC_DYN(UART_RX, KE_BUILD_ID(TASK_UART, 0), TASK_APP,
-                         uart_rx_req, frame_len - 5);
-    req->type = frame[0];
-    req->length = frame_len - 5;
-    memcpy(req->value, &frame[3], frame_len - 5);
-    KE_MSG_SEND(req);
-    frame_len = 0;
-  } break;
   case SL_NONE:
     // Wait for more bytes
+    return;
+  }
+  rx_msg = NULL;
+}
+
+// Have TASK_UART send acknowledgements, release acknowledged messages and
+// send again what was lost
+static void uart_task_link_notify(void) {
+  if (!link_update_pending) {
+    link_update_pending = true;
+    KE_MSG_SEND_BASIC(UART_LINK, TASK_UART, TASK_UART);
+  }
+}
+
+// Deliver the frames that were kept until the ones before them arrived. If
+// there are frames left, the next one is missing too.
+static void uart_task_rx_link_deliver(void) {
+  for (;;) {
+    struct uart_rx_slot *slot = &rx_window[sl_link_slot(uart_link.rx_expected)];
+    if (slot->msg == NULL) {
+      break;
+    }
+    rx_msg = slot->msg;
+    slot->msg = NULL;
+    uart_task_rx_dispatch(slot->res);
+    sl_link_rx_advance(&uart_link);
+  }
+  for (uint8_t i = 0; i < SL_LINK_WINDOW_MAX; i++) {
+    if (rx_window[i].msg != NULL) {
+      sl_link_rx_error(&uart_link);
+      break;
+    }
+  }
+}
+
+// Runs the link layer on a complete frame and delivers, keeps or drops it
+static void uart_task_rx_link(enum sl_status res) {
+  uint8_t type = sl_parser_type(&rx_parser);
+  if (res == SL_ERR) {
+    sl_link_rx_error(&uart_link);
+    uart_task_link_notify();
+    uart_task_rx_dispatch(res);
+    return;
+  }
+  if (!sl_packet_type_is_seq(type)) {
+    // Frames sent before the window was enabled
+    uart_task_rx_dispatch(res);
+    return;
+  }
+
+  uint8_t ack = sl_parser_ack(&rx_parser);
+  if (type == SL_PT_NAK) {
+    uart_link_stats.naks++;
+    if (sl_link_tx_nak(&uart_link, ack)) {
+      tx_window[sl_link_slot(ack)].resend_time = lld_evt_time_get();
+    }
+    uart_task_link_notify();
+    return;
+  }
+  if (sl_link_tx_ack(&uart_link, ack) > 0) {
+    uart_task_link_notify();
+  }
+  if (type == SL_PT_ACK) {
+    return;
+  }
+
+  uint8_t seq = sl_parser_seq(&rx_parser);
+  switch (sl_link_rx_seq(&uart_link, seq)) {
+  case SL_LINK_RX_ACCEPT:
+    uart_task_rx_dispatch(res);
+    uart_task_rx_link_deliver();
     break;
+  case SL_LINK_RX_AHEAD: {
+    struct uart_rx_slot *slot = &rx_window[sl_link_slot(seq)];
+    if (slot->msg == NULL && rx_msg != NULL) {
+      slot->msg = rx_msg;
+      slot->res = res;
+      rx_msg = NULL;
+    }
+  } // fall through
+  default:
+    if (rx_msg != NULL) {
+      KE_MSG_FREE(rx_msg);
+      rx_msg = NULL;
+    }
+    break;
+  }
+  uart_task_link_notify();
+}
+
+// Have TASK_UART parse the RX ring, from the RX interrupt or from TASK_UART
+// with the interrupts disabled
+static void uart_task_rx_notify(void) {
+  if (!rx_drain_pending) {
+    rx_drain_pending = true;
+    KE_MSG_SEND_BASIC(UART_RX_DRAIN, TASK_UART, TASK_UART);
+  }
+}
+
+#if UART_RX_DMA
+// RX half of UART_DMA_CHANNEL_01, see user_periph_setup.c
+#define UART_RX_DMA_CHANNEL DMA_CHANNEL_0
+
+// An MCU that keeps to its credits can't overrun the ring, even if TASK_UART
+// doesn't get to parse it for a while
+_Static_assert(UART_RX_DMA_LEN >=
+                   UART_RX_CREDITS *
+                       SERIAL_LINK_FRAME_LEN_MAX(UART_RX_PAYLOAD_MAX),
+               "UART_RX_DMA_LEN doesn't hold the frames of all credits");
+
+// The DMA fills the ring, see uart_task_rx_dma_start
+static bool rx_dma = false;
+// Where the DMA raises its next interrupt, the half or the end of its buffer
+static uint16_t rx_dma_irq_at = UART_RX_DMA_LEN / 2;
+
+// Make what the DMA wrote since the last call visible in the ring. The half and
+// full interrupts make sure that it wrote less than a whole ring in between.
+// Bytes still on their way out of the FIFO are left to the next call, see
+// uart_task_rx_dma_rearm.
+static void uart_task_rx_dma_sync(void) {
+  uint16_t idx = dma_channel_transfered_bytes(UART_RX_DMA_CHANNEL);
+  rx.wr += (uint16_t)(idx - rx.wr) & (rx.size - 1);
+}
+
+// The DMA wrote over bytes that weren't parsed yet. Drop them and the frame in
+// progress, the link layer asks for it again. Without it the credit of the
+// frame in progress is returned, whole frames lost with the bytes can't be
+// counted. rx_buf holds the frames of all credits, so without the link layer
+// only an MCU that doesn't keep to them gets here.
+static void uart_task_rx_dma_overrun(void) {
+  uart_rx_stats.overruns++;
+  rx.rd = rx.wr;
+  if (rx_msg != NULL) {
+    KE_MSG_FREE(rx_msg);
+    rx_msg = NULL;
+    uart_task_rx_dropped();
+  }
+  sl_parser_init(&rx_parser, NULL, 0, uart_task_rx_alloc);
+  if (sl_link_enabled(&uart_link)) {
+    uart_task_irq_disable();
+    sl_link_rx_error(&uart_link);
+    uart_task_link_notify();
+    uart_task_irq_enable();
+  }
+}
+
+static void uart_task_rx_stamp_push(void);
+
+// Turn the data interrupt of the FIFO back on once TASK_UART has parsed the
+// bytes it announced. What the DMA moved after the interrupt read its count is
+// parsed right away, the interrupt only fires for bytes still to come.
+static void uart_task_rx_dma_rearm(void) {
+  uart_task_irq_disable();
+  uart_rxdata_intr_setf(UART1, UART_BIT_EN);
+  uart_task_rx_dma_sync();
+  if (ring_len(&rx) > 0) {
+    uart_task_rx_stamp_push();
+    uart_task_rx_notify();
+  }
+  uart_task_irq_enable();
+}
+#endif
+
+// Give the frame that was just parsed the time of the RX interrupt that
+// received its last byte, the one before rx.rd. If TASK_UART fell so far behind
+// that the interrupt found no room for its stamp, that of an earlier one.
+static void uart_task_rx_stamp(void) {
+  uint8_t rd = rx_stamps_rd;
+  while (rd != rx_stamps_wr) {
+    struct uart_rx_stamp const *stamp = &rx_stamps[rd % UART_RX_STAMPS];
+    rx_stamp_time = stamp->time;
+    // The next frame may end in the bytes of the same interrupt
+    if ((int16_t)(stamp->wr - rx.rd) >= 0) {
+      break;
+    }
+    rd++;
+  }
+  // The stamp is read before the interrupt may write over it
+  __asm__ volatile("" ::: "memory");
+  rx_stamps_rd = rd;
+  if (rx_msg != NULL &&
+      sl_packet_type_plain(sl_parser_type(&rx_parser)) != SL_PT_BLE_DATA) {
+    ((struct uart_rx_req *)rx_msg)->time = rx_stamp_time;
+  }
+}
+
+// Parse and dispatch the frames in the RX ring, at most
+// UART_RX_FRAMES_PER_DRAIN_MAX of them. If there are bytes left after that
+// TASK_UART goes on with another UART_RX_DRAIN message, so that the messages
+// of the BLE stack aren't held up.
+static void uart_task_rx_drain(void) {
+  // An MCU with credits can't send more than the chip can take, without them
+  // the heap is the limit
+  if (!rx_credits_enabled &&
+      ke_get_mem_usage(KE_MEM_KE_MSG) > ((__SCT_HEAP_MSG_SIZE * 90) / 100)) {
+    // Disable RX interrupts, turn_on_rx_cb has TASK_UART parse the ring again
+    uart_task_rx_intr_set(UART_BIT_DIS);
+    LOG("OOM warning\n");
+    if (turn_on_rx_cb_handle == EASY_TIMER_INVALID_TIMER) {
+      turn_on_rx_cb_handle = app_easy_timer(10, turn_on_rx_cb);
+    }
+    return;
+  }
+
+#if UART_RX_DMA
+  if (ring_len(&rx) > rx.size) {
+    uart_task_rx_dma_overrun();
+  }
+#endif
+
+  uint8_t frames = 0;
+  // Every iteration either completes a frame or empties the ring. The RX
+  // interrupt keeps adding to it meanwhile.
+  while (ring_len(&rx) > 0 && frames < UART_RX_FRAMES_PER_DRAIN_MAX) {
+    enum sl_status res = serial_link_parse_packet_ring(&rx_parser, &rx);
+    if (res == SL_NONE) {
+      continue;
+    }
+    uart_task_rx_stamp();
+    if (sl_link_enabled(&uart_link)) {
+      uart_task_tx_lock();
+      uart_task_rx_link(res);
+      uart_task_tx_unlock();
+    } else {
+      uart_task_rx_dispatch(res);
+    }
+    frames++;
+  }
+
+  uart_rx_stats.frames += frames;
+  uart_rx_stats.frames_per_drain[frames]++;
+
+  if (rx_stalled) {
+    rx_stalled = false;
+    uart_task_rx_intr_set(UART_BIT_EN);
+  }
+  if (ring_len(&rx) > 0 && frames == UART_RX_FRAMES_PER_DRAIN_MAX) {
+    uart_rx_stats.deferred++;
+    uart_task_irq_disable();
+    uart_task_rx_notify();
+    uart_task_irq_enable();
+  }
+#if UART_RX_DMA
+  if (rx_dma) {
+    uart_task_rx_dma_rearm();
+  }
+#endif
+}
+
+// Move what is in the RX FIFO into the free space of the ring, which is split
+// in two in case it wraps around the end of the buffer. If the ring is full
+// the RX interrupt is turned off, otherwise it would fire again right away.
+// The FIFO fills up and flow control holds the MCU back.
+static void uart_task_rx_read(void) {
+  uint8_t *dst;
+  uint16_t dst_len;
+  while ((dst_len = ring_reserve(&rx, &dst)) > 0) {
+    uint16_t read = _read(dst, dst_len);
+    ring_commit(&rx, read);
+    if (read < dst_len) {
+      return;
+    }
+  }
+  if (uart_data_ready_getf(UART1)) {
+    uart_rxdata_intr_setf(UART1, UART_BIT_DIS);
+    rx_stalled = true;
+  }
+}
+
+// Note when the bytes the RX interrupt just put into the ring were received,
+// see uart_task_rx_stamp
+static void uart_task_rx_stamp_push(void) {
+  uint8_t wr = rx_stamps_wr;
+  if (wr != rx_stamps_rd &&
+      rx_stamps[(uint8_t)(wr - 1) % UART_RX_STAMPS].wr == rx.wr) {
+    // Nothing new
+    return;
+  }
+  if ((uint8_t)(wr - rx_stamps_rd) == UART_RX_STAMPS) {
+    return;
+  }
+  struct uart_rx_stamp *stamp = &rx_stamps[wr % UART_RX_STAMPS];
+  stamp->wr = rx.wr;
+  stamp->time = lld_evt_time_get();
+  // The stamp is written before TASK_UART may read it
+  __asm__ volatile("" ::: "memory");
+  rx_stamps_wr = wr + 1;
+}
+
+// UART Receive callback, also called from the DMA interrupt with UART_RX_DMA.
+// Only moves the received bytes into the ring and has TASK_UART parse them,
+// to keep the interrupt short for the BLE stack. See uart_rx_stats for how
+// long it takes.
+static void uart_task_rx_cb(uint16_t _data_cnt) {
+  uint32_t start = SysTick->VAL;
+  uart_rx_stats.irqs++;
+
+#if UART_RX_DMA
+  if (rx_dma) {
+    // The data interrupt of the FIFO only has to wake up TASK_UART, it is off
+    // until TASK_UART has parsed what arrived. The DMA interrupt doesn't
+    // depend on it.
+    uart_rxdata_intr_setf(UART1, UART_BIT_DIS);
+    uart_task_rx_dma_sync();
+  } else {
+    uart_task_rx_read();
+  }
+#else
+  uart_task_rx_read();
+#endif
+  uart_task_rx_stamp_push();
+  uart_task_rx_notify();
+
+  // SysTick counts down
+  uint32_t cycles = (start - SysTick->VAL) & SysTick_LOAD_RELOAD_Msk;
+  uart_rx_stats.irq_cycles_sum += cycles;
+  uart_rx_stats.irq_cycles_max = MAX(uart_rx_stats.irq_cycles_max, cycles);
+}
+
+#if UART_RX_DMA
+static void uart_task_rx_dma_cb(void *user_data, uint16_t len) {
+  rx_dma_irq_at = rx_dma_irq_at == UART_RX_DMA_LEN / 2 ? UART_RX_DMA_LEN
+                                                        : UART_RX_DMA_LEN / 2;
+  dma_channel_update_int_ix(UART_RX_DMA_CHANNEL, rx_dma_irq_at);
+  uart_task_rx_cb(len);
+}
+
+// Have the DMA receive into a buffer in a loop. The CPU wakes up when it is
+// half or completely filled, and on the receive timeout of the UART once the
+// line goes idle. Without hardware flow control the MCU could overrun the
+// ring, so this is only done for an MCU that takes credits. Its buffer is taken
+// from the message heap, which the credits keep from filling up, and kept
+// until the chip resets. If there is no room RX stays with the interrupt.
+static void uart_task_rx_dma_start(void) {
+  if (!ke_check_malloc(UART_RX_DMA_LEN, KE_MEM_KE_MSG)) {
+    LOG("No RX DMA buffer\n");
+    return;
+  }
+  uint8_t *buf = ke_malloc(UART_RX_DMA_LEN, KE_MEM_KE_MSG);
+  rx = (struct ring){.buf = buf, .size = UART_RX_DMA_LEN, .rd = 0, .wr = 0};
+  dma_cfg_t cfg = {
+      .bus_width = DMA_BW_BYTE,
+      .irq_enable = DMA_IRQ_STATE_ENABLED,
+      .irq_nr_of_trans = UART_RX_DMA_LEN / 2,
+      .dreq_mode = DMA_DREQ_TRIGGERED,
+      .src_inc = DMA_INC_FALSE,
+      .dst_inc = DMA_INC_TRUE,
+      .circular = DMA_MODE_CIRCULAR,
+      .dma_prio = DMA_PRIO_0,
+      .dma_idle = DMA_IDLE_INTERRUPTING_MODE,
+      .dma_init = DMA_INIT_AX_BX_AY_BY,
+      .dma_req_mux = DMA_TRIG_UART_RXTX,
+      .src_address = UART_RBR_THR_DLL_REG,
+      .dst_address = (uintptr_t)buf,
+      .length = UART_RX_DMA_LEN,
+      .cb = uart_task_rx_dma_cb,
+      .user_data = NULL,
+  };
+  rx_dma = true;
+  dma_channel_initialize(UART_RX_DMA_CHANNEL, &cfg);
+  NVIC_SetPriority(DMA_IRQn, NVIC_GetPriority(UART_IRQn));
+  dma_channel_enable(UART_RX_DMA_CHANNEL, DMA_STATE_ENABLED);
+}
+#endif
+
+// Handle the UART_RX_DRAIN msg for TASK_UART. Parses and dispatches the frames
+// in the RX ring, with the RX interrupt still filling it.
+static int uart_task_handler_rx_drain(ke_msg_id_t const msgid,
+                                      void const *param,
+                                      ke_task_id_t const dest_id,
+                                      ke_task_id_t const src_id) {
+  // Cleared first, so that bytes arriving during the parsing aren't missed
+  rx_drain_pending = false;
+  uart_task_rx_drain();
+  return KE_MSG_CONSUMED;
+}
+
+// Put the chunks of a message into the window, as many as fit. BLE data is
+// split into tx_ble_chunk byte frames, see uart_task_handler_tx. Returns true
+// once all of them are in.
+static bool uart_task_link_push(struct uart_tx_req const *req,
+                                uint16_t *offset) {
+  uint16_t chunk = req->type == SL_PT_BLE_DATA ? tx_ble_chunk : req->length;
+  do {
+    if (!sl_link_tx_ready(&uart_link)) {
+      return false;
+    }
+#if UART_TX_STREAM
+    // Its frame was acknowledged, but the message wasn't released yet
+    if (tx_window[sl_link_slot(uart_link.tx_next)].req != NULL) {
+      return false;
+    }
+#endif
+    struct uart_tx_slot *slot =
+        &tx_window[sl_link_slot(sl_link_tx_push(&uart_link))];
+    slot->req = req;
+    slot->offset = *offset;
+    slot->len = MIN(chunk, req->length - *offset);
+    *offset += slot->len;
+  } while (*offset < req->length);
+  return true;
+}
+
+// Put queued messages into the window, lane by lane, as long as it has room.
+// Only done once every frame in the window has been sent, so that control
+// messages never wait behind more BLE data than what is being sent.
+static void uart_task_link_fill(void) {
+  if (sl_link_tx_pending(&uart_link)) {
+    return;
+  }
+  for (uint8_t lane = 0; lane < UART_TX_LANES; lane++) {
+    struct uart_tx_queue *q = &tx_lanes[lane];
+    for (;;) {
+      if (q->partial == NULL) {
+        q->partial = uart_task_tx_pop(lane);
+        q->partial_offset = 0;
+        if (q->partial == NULL) {
+          break;
+        }
+      }
+      if (!uart_task_link_push(q->partial, &q->partial_offset)) {
+        return;
+      }
+      q->partial = NULL;
+    }
+  }
+}
+
+#if UART_TX_STREAM
+// True if the TX interrupt may still read the message of frame `seq`
+static bool uart_task_link_streaming(uint8_t seq) {
+  uint8_t from = tx_job_seq;
+  if (tx_msg == NULL && !sl_stream_done(&tx_stream)) {
+    from--;
+  }
+  return (uint8_t)(seq - from) < (uint8_t)(tx_job_end - from);
+}
+
+// Release the messages of acknowledged frames, in order and not before the TX
+// interrupt is done with them
+static void uart_task_link_release(void) {
+  for (; tx_released != uart_link.tx_unacked; tx_released++) {
+    if (uart_task_link_streaming(tx_released)) {
+      return;
+    }
+    struct uart_tx_slot *slot = &tx_window[sl_link_slot(tx_released)];
+    // The message is done with its last chunk
+    if (slot->offset + slot->len == slot->req->length) {
+      KE_MSG_FREE(slot->req);
+    }
+    slot->req = NULL;
+  }
+}
+
+// Mark the frames of the window that haven't been sent yet as sent, the TX
+// interrupt escapes them one after the other. Returns the first of them.
+static uint8_t uart_task_link_take(void) {
+  uint8_t first = uart_link.tx_sent;
+  while (sl_link_tx_pending(&uart_link)) {
+    struct uart_tx_slot const *slot =
+        &tx_window[sl_link_slot(sl_link_tx_next(&uart_link))];
+    if (slot->offset == 0) {
+      uart_task_tx_started(slot->req);
+    }
+  }
+  return first;
+}
+
+// Start the next frame of the job in tx_stream. The acknowledgement is the
+// latest, also for a frame that is sent again. Returns false if there is none.
+static bool uart_task_link_stream_next(void) {
+  if (tx_job_seq == tx_job_end) {
+    return false;
+  }
+  struct uart_tx_slot const *slot = &tx_window[sl_link_slot(tx_job_seq)];
+  sl_stream_init_seq(&tx_stream, slot->req->type, tx_job_seq,
+                     uart_link.rx_expected, &slot->req->value[slot->offset],
+                     slot->len);
+  tx_job_seq++;
+  return true;
+}
+
+// The frame in tx_stream is done, start the next one. Without the link layer
+// that is the next frame of the message being sent or of the next queued one,
+// BLE data goes in frames of tx_ble_chunk bytes. A message being sent when the
+// link layer is enabled is finished first. Returns false if there is none.
+static bool uart_task_tx_stream_next(void) {
+  if (tx_msg != NULL && tx_msg_offset == tx_msg->length) {
+    KE_MSG_FREE(tx_msg);
+    tx_msg = NULL;
+  }
+  if (tx_msg == NULL) {
+    if (sl_link_enabled(&uart_link)) {
+      return uart_task_link_stream_next();
+    }
+    for (uint8_t lane = 0; lane < UART_TX_LANES && tx_msg == NULL; lane++) {
+      tx_msg = uart_task_tx_pop(lane);
+    }
+    if (tx_msg == NULL) {
+      return false;
+    }
+    tx_msg_offset = 0;
+    uart_task_tx_started(tx_msg);
+  }
+  uint16_t chunk =
+      tx_msg->type == SL_PT_BLE_DATA ? tx_ble_chunk : tx_msg->length;
+  uint16_t len = MIN(chunk, tx_msg->length - tx_msg_offset);
+  sl_stream_init(&tx_stream, tx_msg->type, &tx_msg->value[tx_msg_offset], len);
+  tx_msg_offset += len;
+  return true;
+}
+
+// Escape the next chunk into tx_chunk, from TASK_UART or from the TX
+// interrupt. A chunk goes on with the next frame where one ends. Returns the
+// length of the chunk, 0 if there is nothing left to send.
+static uint16_t uart_task_tx_stream_fill(void) {
+  uint16_t len = 0;
+  while (len < sizeof(tx_chunk)) {
+    if (sl_stream_done(&tx_stream) && !uart_task_tx_stream_next()) {
+      break;
+    }
+    len += sl_stream_read(&tx_stream, &tx_chunk[len], sizeof(tx_chunk) - len);
+  }
+  return len;
+}
+
+// Stream the frames from `seq` up to `end`. Returns the length of the first
+// chunk.
+static uint16_t uart_task_link_stream(uint8_t seq, uint8_t end) {
+  tx_job_seq = seq;
+  tx_job_end = end;
+  return uart_task_tx_stream_fill();
+}
+#else
+// Finds room for a frame of up to `len` bytes in tx_buf, after the newest one
+// and before the oldest one that hasn't been acknowledged. With nothing in
+// flight the whole buffer can be used.
+static bool uart_task_link_store(uint16_t len, uint16_t *offset,
+                                 uint16_t *cap) {
+  if (sl_link_in_flight(&uart_link) == 0) {
+    *offset = 0;
+    *cap = sizeof(tx_buf);
+    return true;
+  }
+  uint16_t oldest = tx_window[sl_link_slot(uart_link.tx_unacked)].frame_offset;
+  if (tx_store_end > oldest) {
+    if (tx_store_end + len <= sizeof(tx_buf)) {
+      *offset = tx_store_end;
+      *cap = sizeof(tx_buf) - tx_store_end;
+      return true;
+    }
+    // Wrap around
+    if (len <= oldest) {
+      *offset = 0;
+      *cap = oldest;
+      return true;
+    }
+    return false;
+  }
+  if (tx_store_end + len <= oldest) {
+    *offset = tx_store_end;
+    *cap = oldest - tx_store_end;
+    return true;
+  }
+  return false;
+}
+
+// Format the frames of the window that haven't been sent yet into tx_buf, as
+// many as fit in one piece. Returns the length of that piece.
+static uint16_t uart_task_link_format(uint16_t *offset) {
+  uint16_t len = 0;
+  while (sl_link_tx_pending(&uart_link)) {
+    struct uart_tx_slot *slot = &tx_window[sl_link_slot(uart_link.tx_sent)];
+    struct sl_iov iov = {&slot->req->value[slot->offset], slot->len};
+    uint16_t frame_offset, cap;
+    if (!uart_task_link_store(serial_link_frame_len_bound(iov.data, iov.len),
+                              &frame_offset, &cap) ||
+        (len > 0 && frame_offset != *offset + len)) {
+      break;
+    }
+    slot->frame_offset = frame_offset;
+    slot->frame_len = serial_link_format_seq(
+        &tx_buf[frame_offset], cap, slot->req->type,
+        sl_link_tx_next(&uart_link), uart_link.rx_expected, &iov, 1);
+    tx_store_end = frame_offset + slot->frame_len;
+    if (slot->offset == 0) {
+      uart_task_tx_started(slot->req);
+    }
+    // The message is done with its last chunk
+    if (slot->offset + slot->len == slot->req->length) {
+      KE_MSG_FREE(slot->req);
+    }
+    slot->req = NULL;
+    if (len == 0) {
+      *offset = frame_offset;
+    }
+    len += slot->frame_len;
+  }
+  return len;
+}
+
+#endif
+
+// Start sending what is due, in this order: a NAK, a frame that is asked for
+// again, new frames, or an ACK if there were no new frames to carry it.
+// Nothing is formatted while a transfer is being sent, so without
+// UART_TX_STREAM the TX interrupt stays out of the way with the interrupts
+// enabled.
+static void uart_task_link_kick(void) {
+  // A transfer formatted before the link layer was enabled goes first
+#if UART_TX_STREAM
+  if (tx_busy) {
+    return;
   }
+#else
+  if (tx_busy || tx_next.len > 0) {
+    return;
+  }
+  uint16_t offset;
+#endif
+  const uint8_t *data;
+  uint16_t len;
+  uint8_t seq;
+  if (uart_link.nak_pending) {
+    len = serial_link_format_seq(link_ctrl_buf, sizeof(link_ctrl_buf),
+                                 SL_PT_NAK, uart_link.tx_sent,
+                                 uart_link.rx_expected, NULL, 0);
+    data = link_ctrl_buf;
+    uart_link.nak_pending = false;
+    uart_link.ack_pending = false;
+  } else if (sl_link_tx_resend_next(&uart_link, &seq)) {
+    struct uart_tx_slot const *slot = &tx_window[sl_link_slot(seq)];
+    uint32_t latency =
+        UART_TIME_DIFF(lld_evt_time_get(), slot->resend_time);
+    uart_link_stats.retransmits++;
+    uart_link_stats.retransmit_latency_sum += latency;
+    uart_link_stats.retransmit_latency_max =
+        MAX(uart_link_stats.retransmit_latency_max, latency);
+#if UART_TX_STREAM
+    data = tx_chunk;
+    len = uart_task_link_stream(seq, seq + 1);
+#else
+    data = &tx_buf[slot->frame_offset];
+    len = slot->frame_len;
+#endif
+    ke_timer_set(UART_LINK_TIMEOUT, TASK_UART, UART_LINK_TIMEOUT_TICKS);
+#if UART_TX_STREAM
+  } else if (sl_link_tx_pending(&uart_link)) {
+    seq = uart_task_link_take();
+    data = tx_chunk;
+    len = uart_task_link_stream(seq, uart_link.tx_sent);
+#else
+  } else if ((len = uart_task_link_format(&offset)) > 0) {
+    data = &tx_buf[offset];
+#endif
+    uart_tx_stats.transfers++;
+    uart_link.ack_pending = false;
+    ke_timer_set(UART_LINK_TIMEOUT, TASK_UART, UART_LINK_TIMEOUT_TICKS);
+  } else if (uart_link.ack_pending) {
+    len = serial_link_format_seq(link_ctrl_buf, sizeof(link_ctrl_buf),
+                                 SL_PT_ACK, uart_link.tx_sent,
+                                 uart_link.rx_expected, NULL, 0);
+    data = link_ctrl_buf;
+    uart_link.ack_pending = false;
+  } else {
+    return;
+  }
+  uart_task_tx_handover(data, len);
+}
+
+// Fill the window and send what is due. Must be called after
+// uart_task_tx_lock().
+static void uart_task_link_update(void) {
+  if (sl_link_in_flight(&uart_link) == 0) {
+    ke_timer_clear(UART_LINK_TIMEOUT, TASK_UART);
+  }
+#if UART_TX_STREAM
+  uart_task_link_release();
+#endif
+  uart_task_link_fill();
+  uart_task_link_kick();
+  ke_state_set(TASK_UART, tx_busy || uart_task_tx_queued() ? UART_TX_BUSY
+                                                           : UART_TX_READY);
+}
+
+// Handle the UART_LINK msg for TASK_UART
+static int uart_task_handler_link(ke_msg_id_t const msgid, void const *param,
+                                  ke_task_id_t const dest_id,
+                                  ke_task_id_t const src_id) {
+  uart_task_tx_lock();
+  link_update_pending = false;
+  if (sl_link_enabled(&uart_link)) {
+    uart_task_link_update();
+  }
+  uart_task_tx_unlock();
+  return KE_MSG_CONSUMED;
 }
 
+// Handle the UART_LINK_TIMEOUT msg for TASK_UART. Nothing has been
+// acknowledged for a while, send everything in flight again.
+static int uart_task_handler_link_timeout(ke_msg_id_t const msgid,
+                                          void const *param,
+                                          ke_task_id_t const dest_id,
+                                          ke_task_id_t const src_id) {
+  uart_task_tx_lock();
+  if (sl_link_in_flight(&uart_link) > 0) {
+    uint32_t now = lld_evt_time_get();
+    for (uint8_t seq = uart_link.tx_unacked; seq != uart_link.tx_sent; seq++) {
+      tx_window[sl_link_slot(seq)].resend_time = now;
+    }
+    uart_link_stats.timeouts++;
+    sl_link_tx_resend_all(&uart_link);
+    uart_task_link_update();
+  }
+  uart_task_tx_unlock();
+  return KE_MSG_CONSUMED;
+}
+
+// Enable the window as requested by the MCU and tell it the window that is
+// used. A window of 0 only asks for the current one. Once enabled the window
+// stays until reset, the sequence numbers can't start over.
+static void uart_task_link_enable(uint8_t window) {
+  uart_task_irq_disable();
+  if (!sl_link_enabled(&uart_link) && window > 0) {
+    sl_link_init(&uart_link, MIN(window, SL_LINK_WINDOW_MAX));
+  }
+  uart_task_irq_enable();
+
+  struct uart_tx_req *req = KE_MSG_ALLOC_DYN(UART_TX, KE_BUILD_ID(TASK_UART, 0),
+                                             TASK_APP, uart_tx_req, 2);
+  req->type = SL_PT_CTRL_DATA;
+  req->length = 2;
+  req->value[0] = SL_CTRL_CMD_LINK_WINDOW;
+  req->value[1] = uart_link.window;
+  KE_MSG_SEND(req);
+}
+
+#if UART_TX_STREAM
+// Escape the next chunk and send it. Returns false if there is nothing left.
+static bool uart_task_tx_stream_send(void) {
+  uint16_t len = uart_task_tx_stream_fill();
+  if (len == 0) {
+    return false;
+  }
+  uart_task_tx_handover(tx_chunk, len);
+  return true;
+}
+#else
+static void uart_task_tx_start(void);
+#endif
+
 // UART Transmit callback
 // TX Buffer can be used again
 static void uart_task_tx_cb(uint16_t data_cnt) {
-  // Changing task state will trigger kernel to serve all saved messages
+  tx_busy = false;
+#if UART_TX_STREAM
+  // Escape the next chunk while the FIFO still holds the end of this one.
+  // TASK_UART only hears about it once there is nothing left.
+  if (uart_task_tx_stream_send()) {
+    return;
+  }
+#else
+  // Keep the UART busy with what was formatted in the meantime, TASK_UART
+  // formats the transfer after it
+  uart_task_tx_start();
+#endif
   KE_MSG_SEND_BASIC(UART_TX_DONE, TASK_UART, TASK_APP);
 }
 
+struct uart_ping_stats uart_ping_stats = {0};
+// Id of the last PING of the chip, only its response is measured
+static uint8_t ping_id = 0;
+// lld_evt_time_get() when the PING with ping_id was queued
+static uint32_t ping_time = 0;
+
+// Upper bound of the bucket that holds the latency at `percent`
+static uint32_t
+uart_task_latency_percentile(const struct uart_latency_stats *s,
+                             uint8_t percent) {
+  uint32_t rank = ((uint64_t)s->count * percent + 99) / 100;
+  uint32_t seen = 0;
+  for (uint8_t i = 0; i < UART_LATENCY_BUCKETS - 1; i++) {
+    seen += s->buckets[i];
+    if (seen >= rank) {
+      return MIN(UART_LATENCY_BUCKET_US << i, s->max);
+    }
+  }
+  return s->max;
+}
+
+// Count, min, average, max and the 50th, 90th and 99th percentile
+#define UART_LATENCY_REPORT_LEN (7 * 4)
+
+// Write little endian counters to a stats reply, returns the end
+static uint8_t *uart_task_counters_report(uint8_t *buf, const uint32_t *values,
+                                          uint8_t count) {
+  for (uint8_t i = 0; i < count; i++) {
+    write_u32_le(buf, values[i]);
+    buf += 4;
+  }
+  return buf;
+}
+
+static uint8_t *uart_task_latency_report(uint8_t *buf,
+                                         const struct uart_latency_stats *s) {
+  const uint32_t values[] = {
+      s->count,
+      s->min,
+      s->count > 0 ? s->sum / s->count : 0,
+      s->max,
+      uart_task_latency_percentile(s, 50),
+      uart_task_latency_percentile(s, 90),
+      uart_task_latency_percentile(s, 99),
+  };
+  return uart_task_counters_report(buf, values, ARRAY_LEN(values));
+}
+
+// Frames, deferred, overruns and the histogram of frames per UART_RX_DRAIN
+#define UART_RX_STATS_REPORT_LEN ((3 + UART_RX_FRAMES_PER_DRAIN_MAX + 1) * 4)
+
+// The RX counters that only TASK_UART updates
+static uint8_t *uart_task_rx_stats_report(uint8_t *buf) {
+  const uint32_t values[] = {
+      uart_rx_stats.frames,
+      uart_rx_stats.deferred,
+      uart_rx_stats.overruns,
+  };
+  buf = uart_task_counters_report(buf, values, ARRAY_LEN(values));
+  return uart_task_counters_report(buf, uart_rx_stats.frames_per_drain,
+                                   ARRAY_LEN(uart_rx_stats.frames_per_drain));
+}
+
+// Retransmits, NAKs, timeouts and the mean and largest retransmit latency
+#define UART_LINK_STATS_REPORT_LEN (5 * 4)
+
+// The counters of the link layer, in microseconds like the latencies
+static uint8_t *uart_task_link_counters_report(uint8_t *buf) {
+  // Taken together while the link layer can't update them
+  uart_task_irq_disable();
+  struct uart_link_stats stats = uart_link_stats;
+  uart_task_irq_enable();
+  const uint32_t values[] = {
+      stats.retransmits,
+      stats.naks,
+      stats.timeouts,
+      stats.retransmits > 0
+          ? UART_TIME_US(stats.retransmit_latency_sum / stats.retransmits)
+          : 0,
+      UART_TIME_US(stats.retransmit_latency_max),
+  };
+  return uart_task_counters_report(buf, values, ARRAY_LEN(values));
+}
+
+// Answer SL_CTRL_CMD_LINK_STATS with the round trip, queue delay, clock offset,
+// the delay of each TX lane and the number of messages and transfers sent. The
+// batching factor is messages / transfers. Then the number of RX interrupts
+// and the mean and largest number of cycles spent in them, the RX counters of
+// uart_rx_stats and the counters of uart_link_stats. Last the resolution of
+// the times in microseconds, UART_TIME_RESOLUTION_US.
+static void uart_task_link_stats_report(void) {
+  const uint16_t len = 1 + (2 + UART_TX_LANES) * UART_LATENCY_REPORT_LEN + 4 +
+                       5 * 4 + UART_RX_STATS_REPORT_LEN +
+                       UART_LINK_STATS_REPORT_LEN + 4;
+  struct uart_tx_req *req = KE_MSG_ALLOC_DYN(UART_TX, KE_BUILD_ID(TASK_UART, 0),
+                                             TASK_APP, uart_tx_req, len);
+  req->type = SL_PT_CTRL_DATA;
+  req->length = len;
+  req->value[0] = SL_CTRL_CMD_LINK_STATS;
+  uint8_t *buf = uart_task_latency_report(&req->value[1], &uart_ping_stats.rtt);
+  buf = uart_task_latency_report(buf, &uart_ping_stats.queue_delay);
+  write_u32_le(buf, uart_ping_stats.clock_offset);
+  buf += 4;
+  for (uint8_t lane = 0; lane < UART_TX_LANES; lane++) {
+    buf = uart_task_latency_report(buf, &uart_tx_stats.lane_delay[lane]);
+  }
+  write_u32_le(buf, uart_tx_stats.messages);
+  write_u32_le(buf + 4, uart_tx_stats.transfers);
+  buf += 8;
+  // RX interrupts and their mean and longest duration in CPU cycles, taken
+  // together while the RX interrupt can't update them
+  uart_task_irq_disable();
+  uint32_t irqs = uart_rx_stats.irqs;
+  uint64_t cycles = uart_rx_stats.irq_cycles_sum;
+  uint32_t cycles_max = uart_rx_stats.irq_cycles_max;
+  uart_task_irq_enable();
+  write_u32_le(buf, irqs);
+  write_u32_le(buf + 4, irqs > 0 ? (uint32_t)(cycles / irqs) : 0);
+  write_u32_le(buf + 8, cycles_max);
+  buf += 12;
+  buf = uart_task_rx_stats_report(buf);
+  buf = uart_task_link_counters_report(buf);
+  write_u32_le(buf, UART_TIME_RESOLUTION_US);
+  KE_MSG_SEND(req);
+}
+
+// Answer a PING of the MCU, or measure the response to one of ours
+static void uart_task_ping(struct uart_rx_req const *msg) {
+  if (msg->length == SL_PING_REQUEST_LEN &&
+      msg->value[0] == SL_PING_REQUEST) {
+    struct uart_tx_req *req =
+        KE_MSG_ALLOC_DYN(UART_TX, KE_BUILD_ID(TASK_UART, 0), TASK_APP,
+                         uart_tx_req, SL_PING_RESPONSE_LEN);
+    req->type = SL_PT_PING;
+    req->length = SL_PING_RESPONSE_LEN;
+    memcpy(&req->value[0], &msg->value[0], SL_PING_REQUEST_LEN);
+    req->value[0] = SL_PING_RESPONSE;
+    write_u32_le(&req->value[6], UART_TIME_US(msg->time));
+    write_u32_le(&req->value[10], UART_TIME_US(lld_evt_time_get()));
+    KE_MSG_SEND(req);
+    return;
+  }
+  if (msg->length != SL_PING_RESPONSE_LEN ||
+      msg->value[0] != SL_PING_RESPONSE || msg->value[1] != ping_id) {
+    return;
+  }
+  uint32_t sent = read_u32_le(&msg->value[2]);
+  uint32_t peer_received = read_u32_le(&msg->value[6]);
+  uint32_t peer_sent = read_u32_le(&msg->value[10]);
+  // Relative to when the request was sent, the clock of the chip may have
+  // wrapped around in between
+  uint32_t round_trip = UART_TIME_US(UART_TIME_DIFF(msg->time, ping_time));
+  uint32_t received = sent + round_trip;
+  // The MCU may count a longer turnaround than the whole round trip by our
+  // coarser clock
+  int32_t rtt = (int32_t)round_trip - (int32_t)(peer_sent - peer_received);
+  uart_task_latency_add(&uart_ping_stats.rtt, rtt > 0 ? rtt : 0);
+  uart_ping_stats.clock_offset =
+      ((int64_t)(int32_t)(peer_received - sent) +
+       (int32_t)(peer_sent - received)) /
+      2;
+}
+
+// Handle the UART_PING msg for TASK_UART
+static int uart_task_handler_ping(ke_msg_id_t const msgid, void const *param,
+                                  ke_task_id_t const dest_id,
+                                  ke_task_id_t const src_id) {
+  struct uart_tx_req *req =
+      KE_MSG_ALLOC_DYN(UART_TX, KE_BUILD_ID(TASK_UART, 0), TASK_APP,
+                       uart_tx_req, SL_PING_REQUEST_LEN);
+  req->type = SL_PT_PING;
+  req->length = SL_PING_REQUEST_LEN;
+  req->value[0] = SL_PING_REQUEST;
+  req->value[1] = ++ping_id;
+  ping_time = lld_evt_time_get();
+  write_u32_le(&req->value[2], UART_TIME_US(ping_time));
+  KE_MSG_SEND(req);
+  ke_timer_set(UART_PING, TASK_UART, UART_PING_PERIOD_TICKS);
+  return KE_MSG_CONSUMED;
+}
+
 void uart_task_notify_connection_status(uint8_t status) {
   struct uart_tx_req *req = KE_MSG_ALLOC_DYN(UART_TX, KE_BUILD_ID(TASK_UART, 0),
                                              TASK_APP, uart_tx_req, 2);
@@ -135,18 +1419,40 @@ void uart_task_notify_connection_status(uint8_t status) {
   KE_MSG_SEND(req);
 }
 
+// Hand the frame within an SL_CTRL_CMD_COMPRESSED frame to TASK_UART. Returns
+// false if it is malformed.
+static bool uart_task_rx_decompress(struct uart_rx_req const *msg) {
+  if (msg->length < 2) {
+    return false;
+  }
+  int32_t len = sl_rle_decode(NULL, 0, &msg->value[2], msg->length - 2);
+  if (len < 0 || 1 + len > UART_RX_DECODED_MAX) {
+    return false;
+  }
+  struct uart_rx_req *req = KE_MSG_ALLOC_DYN(
+      UART_RX, KE_BUILD_ID(TASK_UART, 0), TASK_APP, uart_rx_req, 1 + len);
+  req->type = msg->type;
+  req->length = 1 + len;
+  req->time = msg->time;
+  req->value[0] = msg->value[1];
+  sl_rle_decode(&req->value[1], len, &msg->value[2], msg->length - 2);
+  KE_MSG_SEND(req);
+  return true;
+}
+
 // Handle the UART_RX msg for TASK_UART
 int uart_task_handler_rx(ke_msg_id_t const msgid, void const *param,
                          ke_task_id_t const dest_id,
                          ke_task_id_t const src_id) {
   // LOG("uart_task_handler_rx_cb\n");
   struct uart_rx_req *msg = (struct uart_rx_req *)param;
+  uart_task_latency_add(
+      &uart_ping_stats.queue_delay,
+      UART_TIME_US(UART_TIME_DIFF(lld_evt_time_get(), msg->time)));
   switch (msg->type) {
   case SL_PT_ACK:
-    // Handle ACK
-    break;
   case SL_PT_NAK:
-    // Handle NAK
+    // Handled by the link layer while the RX ring is parsed
     break;
   case SL_PT_CTRL_DATA: {
     uint8_t cmd = msg->value[0];
@@ -235,12 +1541,29 @@ int uart_task_handler_rx(ke_msg_id_t const msgid, void const *param,
         rf_pa_pwr_adv_set(msg->value[1]);
       }
     } break;
+    case SL_CTRL_CMD_LINK_WINDOW: {
+      if (msg->length != 2) {
+        LOG("invalid length");
+        break;
+      }
+      uart_task_link_enable(msg->value[1]);
+    } break;
+    case SL_CTRL_CMD_LINK_STATS:
+      uart_task_link_stats_report();
+      break;
+    case SL_CTRL_CMD_COMPRESSED:
+      if (uart_task_rx_decompress(msg)) {
+        // The credit is returned once the decoded frame is handled
+        return KE_MSG_CONSUMED;
+      }
+      LOG("invalid compressed frame");
+      break;
     default:
       break;
     }
   } break;
   case SL_PT_PING:
-    // Handle ping
+    uart_task_ping(msg);
     break;
   case SL_PT_BLE_DATA:
     // BLE data should've been sent to TASK_APP from the rx callback
@@ -248,64 +1571,275 @@ int uart_task_handler_rx(ke_msg_id_t const msgid, void const *param,
   default:
     break;
   }
+
+  uart_task_rx_consumed(1);
   return (KE_MSG_CONSUMED);
 }
 
-// Handle the UART_TX msg for TASK_UART
-int uart_task_handler_tx(ke_msg_id_t const msgid, void const *param,
-                         ke_task_id_t const dest_id,
-                         ke_task_id_t const src_id) {
+#if UART_TX_STREAM
+// Without the link layer, start sending what is queued. The TX interrupt goes
+// on with the messages queued in the meantime. Must be called after
+// uart_task_tx_lock().
+static void uart_task_tx_kick(void) {
+  if (!tx_busy && uart_task_tx_stream_send()) {
+    uart_tx_stats.transfers++;
+  }
+  ke_state_set(TASK_UART, tx_busy || uart_task_tx_queued() ? UART_TX_BUSY
+                                                           : UART_TX_READY);
+}
+#else
+// Format all frames of a message into buf. We only generate BLE messages that
+// are multiples of 64 bytes long (see user_custs1_impl.c), they are formatted
+// in frames of tx_ble_chunk bytes.
+static uint16_t uart_task_tx_format(uint8_t *buf, uint16_t buf_len,
+                                    struct uart_tx_req const *req) {
+  uint16_t chunk = req->type == SL_PT_BLE_DATA ? tx_ble_chunk : req->length;
+  uint16_t write_offset = 0;
+  uint16_t read_offset = 0;
+  do {
+    uint16_t len = MIN(chunk, req->length - read_offset);
+    write_offset +=
+        serial_link_format(&buf[write_offset], buf_len - write_offset,
+                           req->type, &req->value[read_offset], len);
+    read_offset += len;
+  } while (read_offset < req->length);
+  return write_offset;
+}
 
-  ke_state_set(TASK_UART, UART_TX_BUSY);
+// Upper bound of what uart_task_tx_format writes for a message
+static uint16_t uart_task_tx_len_max(struct uart_tx_req const *req) {
+  uint16_t chunk = req->type == SL_PT_BLE_DATA ? tx_ble_chunk : req->length;
+  uint16_t len = 0;
+  uint16_t read_offset = 0;
+  do {
+    uint16_t payload_len = MIN(chunk, req->length - read_offset);
+    len += serial_link_frame_len_bound(&req->value[read_offset], payload_len);
+    read_offset += payload_len;
+  } while (read_offset < req->length);
+  return len;
+}
 
-  struct uart_tx_req const *req = (struct uart_tx_req const *)param;
+// Finds room in tx_buf for the next transfer, the larger part before or after
+// the transfer being sent. Transfers take at most half of tx_buf, so that the
+// one after them can be formatted while they are sent.
+static uint16_t uart_task_tx_room(uint16_t *offset) {
+  uint16_t room = sizeof(tx_buf);
+  *offset = 0;
+  if (tx_busy) {
+    uint16_t end = tx_sending.offset + tx_sending.len;
+    if (sizeof(tx_buf) - end >= tx_sending.offset) {
+      *offset = end;
+      room = sizeof(tx_buf) - end;
+    } else {
+      room = tx_sending.offset;
+    }
+  }
+  return MIN(room, sizeof(tx_buf) / 2);
+}
 
-  int16_t write_offset = 0;
+// Moves the last `len - first` bytes of buf in front of the others
+static void uart_task_tx_rotate(uint8_t *buf, uint16_t len, uint16_t first) {
+  const uint16_t parts[][2] = {{0, first}, {first, len}, {0, len}};
+  for (uint8_t p = 0; p < 3; p++) {
+    for (uint16_t i = parts[p][0], j = parts[p][1]; i + 1 < j; i++, j--) {
+      uint8_t byte = buf[i];
+      buf[i] = buf[j - 1];
+      buf[j - 1] = byte;
+    }
+  }
+}
 
-  switch (req->type) {
-  case SL_PT_CTRL_DATA: {
-    write_offset +=
-        serial_link_format(&tx_buf[write_offset], sizeof(tx_buf) - write_offset,
-                           req->type, &req->value[0], req->length);
+// Control messages queued after tx_next was formatted go behind its control
+// frames and in front of its BLE data, so that they only wait for the transfer
+// being sent. tx_next is taken back unless the TX interrupt started it in the
+// meantime, the messages are formatted after it and rotated into place.
+static void uart_task_tx_prepend(void) {
+  struct co_list *ctrl = &tx_lanes[UART_TX_LANE_CTRL].msgs;
+  if (co_list_is_empty(ctrl)) {
+    return;
+  }
+  uart_task_irq_disable();
+  struct uart_tx_batch next = {tx_next.offset, tx_next.len, tx_next.ctrl_len};
+  tx_next.len = 0;
+  uart_task_irq_enable();
+  if (next.len == 0) {
+    return;
+  }
+  // The room uart_task_tx_room found for it. The transfer being sent may have
+  // ended since, which only leaves more.
+  uint16_t end = MIN(next.offset + sizeof(tx_buf) / 2, sizeof(tx_buf));
+  if (tx_busy && tx_sending.offset > next.offset) {
+    end = MIN(end, tx_sending.offset);
+  }
+  uint16_t write_offset = next.offset + next.len;
+  struct co_list_hdr *hdr;
+  while ((hdr = co_list_pick(ctrl)) != NULL) {
+    struct uart_tx_req const *req = ke_msg2param((struct ke_msg *)hdr);
+    if (write_offset + uart_task_tx_len_max(req) > end) {
+      break;
+    }
+    uart_task_tx_pop(UART_TX_LANE_CTRL);
+    write_offset += uart_task_tx_format(&tx_buf[write_offset],
+                                        sizeof(tx_buf) - write_offset, req);
+    uart_task_tx_started(req);
+    KE_MSG_FREE(req);
+  }
+  uint16_t added = write_offset - next.offset - next.len;
+  uart_task_tx_rotate(&tx_buf[next.offset + next.ctrl_len],
+                      next.len - next.ctrl_len + added,
+                      next.len - next.ctrl_len);
+  uart_task_irq_disable();
+  tx_next.offset = next.offset;
+  tx_next.len = next.len + added;
+  tx_next.ctrl_len = next.ctrl_len + added;
+  uart_task_irq_enable();
+}
 
-  } break;
-  case SL_PT_BLE_DATA: {
-    // We only generate messages that are multiples of 64 bytes long (see
-    // user_custs1_impl.c). Format every 64 byte packet as separate frames.
-    uint16_t read_offset = 0;
-    while (read_offset < req->length) {
-      write_offset += serial_link_format(
-          &tx_buf[write_offset], sizeof(tx_buf) - write_offset, req->type,
-          &req->value[read_offset], 64);
-      read_offset += 64;
+// Without the link layer, format as many messages as fit into the room for
+// the next transfer. The lanes are served in order and a message that doesn't
+// fit ends the batch, so nothing overtakes it. With nothing being sent the
+// first message is always taken.
+//
+// Runs with the interrupts enabled. While tx_next is empty the TX interrupt
+// can only end the transfer being sent, which leaves the room found for the
+// next one free, so they are only disabled to publish tx_next.
+static void uart_task_tx_prepare(void) {
+  if (tx_next.len > 0) {
+    uart_task_tx_prepend();
+    return;
+  }
+  uint16_t offset;
+  uint16_t room = uart_task_tx_room(&offset);
+  uint16_t end = offset + room;
+  uint16_t write_offset = offset;
+  uint16_t ctrl_len = 0;
+  for (uint8_t lane = 0; lane < UART_TX_LANES; lane++) {
+    struct co_list_hdr *hdr;
+    while ((hdr = co_list_pick(&tx_lanes[lane].msgs)) != NULL) {
+      struct uart_tx_req const *req = ke_msg2param((struct ke_msg *)hdr);
+      if ((tx_busy || write_offset > offset) &&
+          write_offset + uart_task_tx_len_max(req) > end) {
+        break;
+      }
+      uart_task_tx_pop(lane);
+      write_offset += uart_task_tx_format(&tx_buf[write_offset],
+                                          sizeof(tx_buf) - write_offset, req);
+      uart_task_tx_started(req);
+      KE_MSG_FREE(req);
+    }
+    if (lane == UART_TX_LANE_CTRL) {
+      ctrl_len = write_offset - offset;
+    }
+    if (hdr != NULL) {
+      break;
     }
-  } break;
-  default:
-    LOG("uart_task: Error unexpected req->type");
-    break;
   }
+  uart_task_irq_disable();
+  tx_next.offset = offset;
+  tx_next.len = write_offset - offset;
+  tx_next.ctrl_len = ctrl_len;
+  uart_task_irq_enable();
+}
 
-  uart_send(UART1, &tx_buf[0], write_offset, UART_OP_INTR);
+// Start sending the transfer formatted by uart_task_tx_prepare, from the TX
+// interrupt or from TASK_UART with the interrupts disabled
+static void uart_task_tx_start(void) {
+  if (tx_busy || tx_next.len == 0) {
+    return;
+  }
+  tx_sending = tx_next;
+  tx_next.len = 0;
+  tx_busy = true;
+  uart_tx_stats.transfers++;
+  uart_send(UART1, &tx_buf[tx_sending.offset], tx_sending.len, UART_TX_OP);
+}
 
-  return (KE_MSG_CONSUMED);
-};
+// Without the link layer, send what is queued and format the next transfer
+// while it is sent
+static void uart_task_tx_kick(void) {
+  uart_task_tx_prepare();
+  uart_task_irq_disable();
+  uart_task_tx_start();
+  uart_task_irq_enable();
+  uart_task_tx_prepare();
+  ke_state_set(TASK_UART, tx_busy || uart_task_tx_queued() ? UART_TX_BUSY
+                                                           : UART_TX_READY);
+}
+
+#endif
+
+// Replace a control message by its compressed form if the MCU supports that
+// and it is shorter, see SL_CTRL_CMD_COMPRESSED
+static struct uart_tx_req *uart_task_tx_compress(struct uart_tx_req *req) {
+  if (!serial_link_compression() || req->type != SL_PT_CTRL_DATA ||
+      req->length < UART_TX_COMPRESS_MIN) {
+    return req;
+  }
+  // Skip the command byte
+  uint16_t len = sl_rle_encode(NULL, 0, &req->value[1], req->length - 1);
+  if (2 + len >= req->length) {
+    return req;
+  }
+  struct uart_tx_req *compressed =
+      KE_MSG_ALLOC_DYN(UART_TX, KE_BUILD_ID(TASK_UART, 0), TASK_APP,
+                       uart_tx_req, 2 + len);
+  compressed->type = req->type;
+  compressed->length = 2 + len;
+  compressed->value[0] = SL_CTRL_CMD_COMPRESSED;
+  compressed->value[1] = req->value[0];
+  sl_rle_encode(&compressed->value[2], len, &req->value[1], req->length - 1);
+  KE_MSG_FREE(req);
+  return compressed;
+}
+
+// Handle the UART_TX msg for TASK_UART
+int uart_task_handler_tx(ke_msg_id_t const msgid, void const *param,
+                         ke_task_id_t const dest_id,
+                         ke_task_id_t const src_id) {
+  struct uart_tx_req *req = (struct uart_tx_req *)param;
+
+  if (req->type != SL_PT_CTRL_DATA && req->type != SL_PT_BLE_DATA &&
+      req->type != SL_PT_PING) {
+    LOG("uart_task: Error unexpected req->type");
+    return KE_MSG_CONSUMED;
+  }
+
+  // The message is released once it has been sent
+  req = uart_task_tx_compress(req);
+  req->time = lld_evt_time_get();
+  uart_task_tx_lock();
+  co_list_push_back(&tx_lanes[uart_task_tx_lane(req->type)].msgs,
+                    &ke_param2msg(req)->hdr);
+  if (sl_link_enabled(&uart_link)) {
+    uart_task_link_update();
+  } else {
+    uart_task_tx_kick();
+  }
+  uart_task_tx_unlock();
+  return KE_MSG_NO_FREE;
+}
 
 int uart_task_handler_tx_done(ke_msg_id_t const msgid, void const *param,
                               ke_task_id_t const dest_id,
                               ke_task_id_t const src_id) {
-  ke_state_set(TASK_UART, UART_TX_READY);
+  uart_task_tx_lock();
+  if (sl_link_enabled(&uart_link)) {
+    uart_task_link_update();
+  } else {
+    uart_task_tx_kick();
+  }
+  uart_task_tx_unlock();
   return KE_MSG_CONSUMED;
 }
+
 const struct ke_msg_handler uart_default_state[] = {
     {UART_TX, uart_task_handler_tx},
     {UART_TX_DONE, uart_task_handler_tx_done},
     {UART_RX, uart_task_handler_rx},
-};
-
-const struct ke_msg_handler uart_tx_busy_state[] = {
-    {UART_TX, ke_msg_save},
-    {UART_TX_DONE, uart_task_handler_tx_done},
-    {UART_RX, uart_task_handler_rx},
+    {UART_RX_DRAIN, uart_task_handler_rx_drain},
+    {UART_LINK, uart_task_handler_link},
+    {UART_LINK_TIMEOUT, uart_task_handler_link_timeout},
+    {UART_PING, uart_task_handler_ping},
 };
 
 const struct ke_state_handler uart_default_handler =
@@ -314,7 +1848,7 @@ const struct ke_state_handler uart_default_handler =
 const struct ke_state_handler uart_state_handler[UART_STATE_MAX] = {
     [UART_DISABLED] = KE_STATE_HANDLER_NONE,
     [UART_TX_READY] = KE_STATE_HANDLER_NONE,
-    [UART_TX_BUSY] = KE_STATE_HANDLER(uart_tx_busy_state),
+    [UART_TX_BUSY] = KE_STATE_HANDLER_NONE,
 };
 
 static const struct ke_task_desc TASK_DESC_UART = {
@@ -327,13 +1861,45 @@ void uart_task_init(void) {
 }
 
 void uart_task_enable(void) {
+  // Legacy MCU firmware expects every 64 byte packet in a frame of its own
+  tx_ble_chunk = UART_BLE_PACKET_LEN;
+  if (sl_peer_caps.version > 0) {
+    uint16_t max = MIN(sl_peer_caps.frame_max, UART_BLE_CHUNK_MAX);
+    tx_ble_chunk = MAX(max - max % UART_BLE_PACKET_LEN, UART_BLE_PACKET_LEN);
+  }
+
+  // Free running without its interrupt, times the RX interrupt. Nothing else
+  // uses SysTick.
+  SysTick->LOAD = SysTick_LOAD_RELOAD_Msk;
+  SysTick->VAL = 0;
+  SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_ENABLE_Msk;
+
+  // In the framing negotiated during boot
+  sl_parser_init(&rx_parser, NULL, 0, uart_task_rx_alloc);
   uart_register_rx_cb(UART1, uart_task_rx_cb);
   uart_register_tx_cb(UART1, uart_task_tx_cb);
 
+#if UART_RX_DMA
+  // Before the RX interrupt is enabled, so that all bytes go through the DMA
+  if (sl_peer_caps.version >= 2) {
+    uart_task_rx_dma_start();
+  }
+#endif
+
   // Enable uart receive interrupts
   uart_receive(UART1, NULL, 1, UART_OP_INTR);
 
   ke_state_set(TASK_UART, UART_TX_READY);
+
+  // Legacy MCU firmware doesn't know what to do with a PING
+  if (sl_peer_caps.version > 0) {
+    ke_timer_set(UART_PING, TASK_UART, UART_PING_PERIOD_TICKS);
+  }
+  if (sl_peer_caps.version >= 2) {
+    rx_credits_enabled = true;
+    rx_consumed = 0;
+    uart_task_rx_grant();
+  }
 }
 
 #if !NDEBUG
@@ -33,7 +33,7 @@ enum uart_state {
   UART_DISABLED,
   // UART enabled
   UART_TX_READY,
-  // UART busy
+  // UART busy or messages waiting to be sent
   UART_TX_BUSY,
   // Number of defined states
   UART_STATE_MAX,
@@ -43,17 +43,205 @@ enum uart_msg_id {
   UART_TX = KE_FIRST_MSG(TASK_UART), // There is data to send
   UART_TX_DONE,                      // TX is done
   UART_RX,                           // There is data to be received
+  UART_RX_DRAIN,                     // There are bytes in the RX ring
+  UART_LINK,                         // The link layer has work to do
+  UART_LINK_TIMEOUT,                 // Unacknowledged frames timed out
+  UART_PING,                         // Time to measure the round trip
 };
 
+// Receive through a circular DMA buffer instead of reading the RX FIFO in the
+// UART interrupt, for an MCU that takes credits. See uart_task_rx_dma_start.
+// CFG_UART_DMA_SUPPORT is off until this has been measured on the chip.
+#ifndef UART_RX_DMA
+#if defined(CFG_UART_DMA_SUPPORT)
+#define UART_RX_DMA 1
+#else
+#define UART_RX_DMA 0
+#endif
+#endif
+
+// Send through the DMA, with one interrupt per transfer instead of one per
+// refill of the TX FIFO
+#ifndef UART_TX_DMA
+#if defined(CFG_UART_DMA_SUPPORT)
+#define UART_TX_DMA 1
+#else
+#define UART_TX_DMA 0
+#endif
+#endif
+
+// Escape frames straight out of the queued messages in the TX interrupt, a
+// chunk at a time, instead of formatting them into a buffer first. There is no
+// limit on the length of a frame then. With the link layer a message is kept
+// until its frames are acknowledged, they are escaped again if they are sent
+// again. See uart_task_tx_stream_fill.
+#ifndef UART_TX_STREAM
+#define UART_TX_STREAM 0
+#endif
+
+// Bytes escaped per chunk with UART_TX_STREAM, two refills of the TX FIFO
+#define UART_TX_STREAM_CHUNK 32
+
+// Size of the DMA RX ring, a power of two. Frames are parsed out of it, so it
+// has to hold what arrives while the parsing is left to TASK_UART. There is no
+// flow control, instead it holds an escaped frame of UART_RX_PAYLOAD_MAX for
+// every credit, 8 * 206 bytes. It is taken from the message heap when the DMA
+// starts, an MCU without credits doesn't need it.
+#define UART_RX_DMA_LEN 2048
+
+// Size of the RX ring without the DMA, a power of two. It holds what arrives
+// until TASK_UART parses it, once it is full flow control holds the MCU back.
+#define UART_RX_RING_LEN 256
+
+// At most this many frames are dispatched per UART_RX_DRAIN message, the rest
+// is dispatched after the messages queued in the meantime.
+#define UART_RX_FRAMES_PER_DRAIN_MAX 4
+
+// The largest payload accepted from the MCU, as long as the frame buffer was
+// before payloads were unescaped straight into kernel messages. Reported to the
+// MCU in the HELLO.
+#define UART_RX_PAYLOAD_MAX 95
+// The largest payload a compressed control frame from the MCU may decode to,
+// see SL_CTRL_CMD_COMPRESSED
+#define UART_RX_DECODED_MAX 256
+// Control payloads shorter than this aren't worth compressing
+#define UART_TX_COMPRESS_MIN 32
+
+// BLE data is sent to the MCU in packets of this length, see
+// user_custs1_impl.c
+#define UART_BLE_PACKET_LEN 64
+// Upper bound of the packets put in one frame, if the MCU accepts that much
+#define UART_BLE_CHUNK_MAX 256
+
+// Unacknowledged frames are sent again after this time, in units of 10ms
+#define UART_LINK_TIMEOUT_TICKS 10
+
+// Frames the MCU may send ahead of the chip consuming them, if it speaks
+// protocol version 2 or later.
+//
+// Every frame takes a credit, except ACK, NAK and frames sent again by the link
+// layer. The chip counts the frames it consumed and grants the MCU a
+// limit with SL_CTRL_CMD_CREDIT and a little endian 16 bit count. The MCU may
+// send while the number of frames it sent is below the limit. Both counts start
+// with the first grant and wrap around. Grants are absolute so that a lost one
+// is made up for by the next.
+//
+// A frame is consumed once TASK_UART has handled it, or for BLE data once
+// TASK_CUSTS1 has confirmed the indication. Without the link layer a frame the
+// chip drops, for example for a bad crc, is consumed too, as nobody sends it
+// again.
+#define UART_RX_CREDITS 8
+
+// Counters for the RX path, sent to the MCU on SL_CTRL_CMD_LINK_STATS
+struct uart_rx_stats {
+  // Number of RX interrupts
+  uint32_t irqs;
+  // Time spent in them, in CPU cycles. uart_task_enable() takes SysTick for
+  // this: it runs free at the CPU clock, without its interrupt, so the SDK
+  // and the application must not use it.
+  uint64_t irq_cycles_sum;
+  uint32_t irq_cycles_max;
+  // Number of frames dispatched
+  uint32_t frames;
+  // Number of times frames were left for another UART_RX_DRAIN message
+  uint32_t deferred;
+  // Histogram of frames dispatched per UART_RX_DRAIN message
+  uint32_t frames_per_drain[UART_RX_FRAMES_PER_DRAIN_MAX + 1];
+  // Number of times the DMA wrote over bytes that weren't parsed yet
+  uint32_t overruns;
+};
+
+extern struct uart_rx_stats uart_rx_stats;
+
+// Counters for the link layer, see sl_link.h. Sent to the MCU on
+// SL_CTRL_CMD_LINK_STATS.
+struct uart_link_stats {
+  // Number of frames sent again
+  uint32_t retransmits;
+  // Number of NAKs received
+  uint32_t naks;
+  // Number of times nothing was acknowledged in time
+  uint32_t timeouts;
+  // Time from a NAK or timeout until the frame was sent again, in units of
+  // UART_TIME_RESOLUTION_US
+  uint32_t retransmit_latency_sum;
+  uint32_t retransmit_latency_max;
+};
+
+extern struct uart_link_stats uart_link_stats;
+
+// The chip sends a PING this often to an MCU that answered the HELLO, in units
+// of 10ms
+#define UART_PING_PERIOD_TICKS 100
+
+// Bucket i of the latency histogram counts latencies below
+// UART_LATENCY_BUCKET_US << i, the last one all others
+#define UART_LATENCY_BUCKETS 12
+#define UART_LATENCY_BUCKET_US 512
+
+// Distribution of a latency, in microseconds
+struct uart_latency_stats {
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint64_t sum;
+  uint32_t buckets[UART_LATENCY_BUCKETS];
+};
+
+// Resolution of the times taken on the chip, the unit of lld_evt_time_get()
+#define UART_TIME_RESOLUTION_US 625
+
+// Latencies of the serial link, sent to the MCU on SL_CTRL_CMD_LINK_STATS.
+// Times on the chip have a resolution of UART_TIME_RESOLUTION_US, which the
+// reply ends with.
+struct uart_ping_stats {
+  // Round trip of the PINGs of the chip, including the time in the TX queue of
+  // the chip and without the time the MCU took to answer
+  struct uart_latency_stats rtt;
+  // Time from the RX interrupt that received the end of a frame to TASK_UART
+  // handling it, which includes waiting for TASK_UART to parse the frame
+  struct uart_latency_stats queue_delay;
+  // Clock of the MCU minus that of the chip, as of the last PING
+  int32_t clock_offset;
+};
+
+extern struct uart_ping_stats uart_ping_stats;
+
+// UART_TX messages are queued in lanes by priority. Frames that are already
+// being sent are finished, after that the lanes are served in this order.
+enum uart_tx_lane {
+  // Control data and PINGs, latency critical
+  UART_TX_LANE_CTRL,
+  // BLE data
+  UART_TX_LANE_BULK,
+  UART_TX_LANES,
+};
+
+// Counters for the TX path
+struct uart_tx_stats {
+  // Time from TASK_UART queueing a message to formatting its first frame
+  struct uart_latency_stats lane_delay[UART_TX_LANES];
+  // Messages whose first frame was sent
+  uint32_t messages;
+  // UART transfers carrying new frames, each holds one or more messages
+  uint32_t transfers;
+};
+
+extern struct uart_tx_stats uart_tx_stats;
+
 struct uart_rx_req {
   enum packet_type type;
   uint16_t length;
+  // lld_evt_time_get() in the RX interrupt that received the end of the frame
+  uint32_t time;
   uint8_t value[__ARRAY_EMPTY];
 };
 
 struct uart_tx_req {
   enum packet_type type;
   uint16_t length;
+  // lld_evt_time_get() when TASK_UART queued the message, set by TASK_UART
+  uint32_t time;
   uint8_t value[__ARRAY_EMPTY];
 };
 
@@ -67,4 +255,9 @@ void debug_uart(const char *msg);
 
 void uart_task_notify_connection_status(uint8_t status);
 
+// An indication of BLE data from the MCU was confirmed
+void uart_task_ble_confirmed(void);
+// The connection is gone, indications that are pending won't be confirmed
+void uart_task_ble_disconnected(void);
+
 #endif
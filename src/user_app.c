@@ -23,6 +23,7 @@
 #include "app_prf_perm_types.h"
 #include "gap.h"
 #include "gattc_task.h"
+#include "sl_link.h"
 #include "uart_task.h"
 #include "util.h"
 #include "version.h"
@@ -207,6 +208,27 @@ void user_app_on_init_cb(void) {
   //  To keep compatibility call default handler
   default_app_on_init();
 
+  // Before anything else is loaded from the MCU
+  const struct sl_caps caps = {
+      .version = SL_PROTOCOL_VERSION,
+      .frame_max = UART_RX_PAYLOAD_MAX,
+      .window = SL_LINK_WINDOW_MAX,
+      .framings = SL_FRAMING_MASK(SL_FRAMING_ESCAPE) |
+                  SL_FRAMING_MASK(SL_FRAMING_COBS),
+      .baud_rates = SL_BAUD_RATE_MASK(SL_BAUD_RATE_115200) |
+                    SL_BAUD_RATE_MASK(SL_BAUD_RATE_460800) |
+                    SL_BAUD_RATE_MASK(SL_BAUD_RATE_921600) |
+                    SL_BAUD_RATE_MASK(SL_BAUD_RATE_1000000),
+      .compressions = SL_COMPRESSION_MASK(SL_COMPRESSION_RLE),
+  };
+  sl_hello(&caps);
+  sl_baud_rate_upgrade(&caps);
+  LOG("peer v%d, frame max %d, window %d, framing %d, baud rate %d, "
+      "compression %d\n",
+      sl_peer_caps.version, sl_peer_caps.frame_max, sl_peer_caps.window,
+      serial_link_framing(), serial_link_baud_rate(),
+      serial_link_compression());
+
 #if (BLE_APP_SEC)
   // Set service security requirements
   app_set_prf_srv_perm(TASK_ID_CUSTS1, APP_CUSTS1_SEC_REQ);
@@ -316,6 +338,7 @@ void user_app_adv_undirect_complete_cb(uint8_t status) {
 void user_app_on_disconnect_cb(struct gapc_disconnect_ind const *param) {
   LOG("app_on_disconnectio_cb\n");
   app_connection_idx = GAP_INVALID_CONIDX;
+  uart_task_ble_disconnected();
   //  Cancel the parameter update request timer
   if (app_param_update_request_timer_used != EASY_TIMER_INVALID_TIMER) {
     app_easy_timer_cancel(app_param_update_request_timer_used);
@@ -395,6 +418,9 @@ void user_app_process_catch_rest_cb(ke_msg_id_t const msgid, void const *param,
     switch (msg_param->handle) {
     case SVC1_IDX_RX_VAL:
       break;
+    case SVC1_IDX_TX_VAL:
+      uart_task_ble_confirmed();
+      break;
 
     default:
       break;
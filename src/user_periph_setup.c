@@ -66,7 +66,7 @@ static const uart_cfg_t uart_cfg = {
     .rx_fifo_tr_lvl = UART_RX_FIFO_LEVEL_3,
     .intr_priority = 2,
 #if defined(CFG_UART_DMA_SUPPORT)
-    // Set UART DMA Channel Pair Configuration
+    // Channel 0 receives into the ring of uart_task.c, channel 1 sends
     .uart_dma_channel = UART_DMA_CHANNEL_01,
     // Set UART DMA Priority
     .uart_dma_priority = DMA_PRIO_0,
@@ -0,0 +1,110 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Checks the engine selected with CRC_ENGINE_* against the bit-by-bit-fast
+// code pycrc generated before the engines were added
+
+#include <string.h>
+
+#include "crc.h"
+#include "test.h"
+
+static crc_t ref_reflect(crc_t data, size_t data_len) {
+  crc_t ret = data & 0x01;
+  for (size_t i = 1; i < data_len; i++) {
+    data >>= 1;
+    ret = (ret << 1) | (data & 0x01);
+  }
+  return ret;
+}
+
+static crc_t ref_update(crc_t crc, const uint8_t *d, size_t data_len) {
+  while (data_len--) {
+    uint8_t c = *d++;
+    for (unsigned int i = 0x01; i & 0xff; i <<= 1) {
+      crc_t bit = (crc & 0x8000) ^ ((c & i) ? 0x8000 : 0);
+      crc <<= 1;
+      if (bit) {
+        crc ^= 0x8005;
+      }
+    }
+    crc &= 0xffff;
+  }
+  return crc & 0xffff;
+}
+
+static crc_t ref_crc(const uint8_t *data, size_t len) {
+  return ref_reflect(ref_update(0x0000, data, len), 16);
+}
+
+static crc_t engine_crc(const uint8_t *data, size_t len) {
+  return crc_finalize(crc_update(crc_init(), data, len));
+}
+
+// CRC-16/ARC check value
+static void test_check_value(void) {
+  const char *check = "123456789";
+  CHECK(engine_crc((const uint8_t *)check, strlen(check)) == 0xbb3d);
+  CHECK(ref_crc((const uint8_t *)check, strlen(check)) == 0xbb3d);
+  CHECK(engine_crc(NULL, 0) == 0x0000);
+}
+
+// Random buffers up to the size of the bond DB and then some, fed at once, a
+// byte at a time and in random pieces
+static void test_random(void) {
+  static uint8_t buf[700];
+  for (int n = 0; n < 20000; n++) {
+    size_t len = test_rand() % (sizeof(buf) + 1);
+    test_rand_fill(buf, len);
+    crc_t expected = ref_crc(buf, len);
+
+    CHECK(engine_crc(buf, len) == expected);
+
+    crc_t crc = crc_init();
+    for (size_t i = 0; i < len; i++) {
+      crc = crc_update_byte(crc, buf[i]);
+    }
+    CHECK(crc_finalize(crc) == expected);
+
+    crc = crc_init();
+    size_t offset = 0;
+    while (offset < len) {
+      size_t piece = 1 + test_rand() % (len - offset);
+      crc = crc_update(crc, &buf[offset], piece);
+      offset += piece;
+    }
+    CHECK(crc_finalize(crc) == expected);
+  }
+}
+
+// A message followed by its little endian crc leaves CRC_RESIDUE, the parser
+// relies on that
+static void test_residue(void) {
+  static uint8_t buf[130];
+  for (int n = 0; n < 1000; n++) {
+    size_t len = test_rand() % (sizeof(buf) - 1);
+    test_rand_fill(buf, len);
+    crc_t crc = engine_crc(buf, len);
+    buf[len] = crc & 0xff;
+    buf[len + 1] = crc >> 8;
+    CHECK(engine_crc(buf, len + 2) == CRC_RESIDUE);
+  }
+}
+
+int main(void) {
+  test_check_value();
+  test_random();
+  test_residue();
+  return 0;
+}
@@ -0,0 +1,397 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// See sdk_sim.h
+
+#include <arch.h>
+#include <app_easy_security.h>
+#include <dma.h>
+#include <ke_mem.h>
+#include <ke_task.h>
+#include <lld_evt.h>
+#include <prf.h>
+#include <rf_531.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uart.h>
+
+#include "sdk_sim.h"
+#include "uart_task.h"
+#include "user_app.h"
+
+long sim_live_msgs = 0;
+long sim_masked_frees = 0;
+uint32_t sim_now = 0;
+uint32_t sim_us = 0;
+UART_BAUDRATE sim_baud_rate = UART_BAUDRATE_115200;
+bool sim_heap_full = false;
+uint16_t sim_mem_usage = 0;
+void (*sim_preempt)(void) = NULL;
+void (*sim_blocking_tx)(const uint8_t *data, uint16_t len) = NULL;
+
+// What user_app.c and the SDK provide, a connection is always up
+uint8_t app_connection_idx = 0;
+uint8_t app_connection_status = 0;
+bool shutting_down = false;
+struct app_device_info device_info;
+
+void user_app_set_scan_rsp_data(uint8_t *data, uint8_t data_len) {}
+void app_easy_security_tk_exch(uint8_t conidx, uint8_t *key, uint8_t length,
+                               bool accept) {}
+void app_easy_gap_disconnect(uint8_t conidx) {}
+void app_easy_gap_advertise_stop(void) {}
+void rf_pa_pwr_adv_set(uint8_t level) {}
+void arch_asm_delay_us(uint32_t us) { sim_us += us; }
+ke_task_id_t prf_get_task_from_id(ke_task_id_t id) { return id; }
+uint16_t ke_get_mem_usage(uint8_t type) { return sim_mem_usage; }
+
+bool ke_check_malloc(uint32_t size, uint8_t type) { return !sim_heap_full; }
+
+void *ke_malloc(uint32_t size, uint8_t type) {
+  ASSERT_ERROR(!sim_heap_full);
+  void *ptr = calloc(1, size);
+  ASSERT_ERROR(ptr != NULL);
+  return ptr;
+}
+
+uint32_t lld_evt_time_get(void) {
+  // 16 ticks of 625us per 10ms
+  return (sim_now * 16) & 0x07ffffff;
+}
+
+// Interrupts are delivered by sim_rx and sim_tx_complete, which check that
+// they aren't disabled
+static int irq_disabled = 0;
+SysTick_Type sim_systick;
+
+void NVIC_DisableIRQ(IRQn_Type irq) { irq_disabled++; }
+void NVIC_EnableIRQ(IRQn_Type irq) { irq_disabled--; }
+
+// Kernel
+
+#define SIM_QUEUE_LEN 1024
+
+static struct ke_msg *queue[SIM_QUEUE_LEN];
+static int queue_len = 0;
+static const struct ke_task_desc *task_desc = NULL;
+static ke_state_t task_state = 0;
+
+void *ke_msg_alloc(ke_msg_id_t id, ke_task_id_t dest_id, ke_task_id_t src_id,
+                   uint16_t param_len) {
+  struct ke_msg *msg = calloc(1, sizeof(struct ke_msg) + param_len);
+  ASSERT_ERROR(msg != NULL);
+  msg->id = id;
+  msg->dest_id = dest_id;
+  msg->src_id = src_id;
+  msg->param_len = param_len;
+  sim_live_msgs++;
+  return ke_msg2param(msg);
+}
+
+void ke_msg_free(void const *param_ptr) {
+  static bool preempting = false;
+  ASSERT_ERROR(param_ptr != NULL);
+  sim_live_msgs--;
+  free(ke_param2msg(param_ptr));
+  if (irq_disabled > 0) {
+    sim_masked_frees++;
+  } else if (sim_preempt != NULL && !preempting) {
+    preempting = true;
+    sim_preempt();
+    preempting = false;
+  }
+}
+
+void ke_msg_send(void const *param_ptr) {
+  ASSERT_ERROR(queue_len < SIM_QUEUE_LEN);
+  queue[queue_len++] = ke_param2msg(param_ptr);
+}
+
+void ke_msg_send_basic(ke_msg_id_t id, ke_task_id_t dest_id,
+                       ke_task_id_t src_id) {
+  ke_msg_send(ke_msg_alloc(id, dest_id, src_id, 0));
+}
+
+void ke_task_create(uint8_t task_type, struct ke_task_desc const *p_task_desc) {
+  task_desc = p_task_desc;
+}
+
+void ke_state_set(ke_task_id_t const id, ke_state_t const state_id) {
+  task_state = state_id;
+}
+
+ke_state_t ke_state_get(ke_task_id_t const id) { return task_state; }
+
+static ke_msg_func_t sim_find_handler(const struct ke_state_handler *handler,
+                                      ke_msg_id_t id) {
+  for (uint16_t i = 0; i < handler->msg_cnt; i++) {
+    if (handler->msg_table[i].id == id) {
+      return handler->msg_table[i].func;
+    }
+  }
+  return NULL;
+}
+
+int sim_run(void) {
+  int handled = 0;
+  while (queue_len > 0) {
+    struct ke_msg *msg = queue[0];
+    queue_len--;
+    memmove(&queue[0], &queue[1], queue_len * sizeof(queue[0]));
+    handled++;
+    if ((msg->dest_id & 0xff) != TASK_UART) {
+      sim_app_msg(msg->id, ke_msg2param(msg));
+      ke_msg_free(ke_msg2param(msg));
+      continue;
+    }
+    ke_msg_func_t func =
+        sim_find_handler(&task_desc->state_handler[task_state], msg->id);
+    if (func == NULL) {
+      func = sim_find_handler(task_desc->default_handler, msg->id);
+    }
+    ASSERT_ERROR(func != NULL);
+    if (func(msg->id, ke_msg2param(msg), msg->dest_id, msg->src_id) ==
+        KE_MSG_CONSUMED) {
+      ke_msg_free(ke_msg2param(msg));
+    }
+  }
+  return handled;
+}
+
+// Timers
+
+#define SIM_TIMERS 8
+
+static struct {
+  ke_msg_id_t id;
+  uint32_t expires;
+  bool active;
+} timers[SIM_TIMERS];
+static void (*easy_timer_fn)(void) = NULL;
+static uint32_t easy_timer_expires = 0;
+
+void ke_timer_set(ke_msg_id_t const timer_id, ke_task_id_t const task,
+                  uint32_t const delay) {
+  ke_timer_clear(timer_id, task);
+  for (int i = 0; i < SIM_TIMERS; i++) {
+    if (!timers[i].active) {
+      timers[i].id = timer_id;
+      timers[i].expires = sim_now + delay;
+      timers[i].active = true;
+      return;
+    }
+  }
+  ASSERT_ERROR(false);
+}
+
+void ke_timer_clear(ke_msg_id_t const timer_id, ke_task_id_t const task) {
+  for (int i = 0; i < SIM_TIMERS; i++) {
+    if (timers[i].active && timers[i].id == timer_id) {
+      timers[i].active = false;
+    }
+  }
+}
+
+timer_hnd app_easy_timer(uint32_t delay, void (*fn)(void)) {
+  ASSERT_ERROR(easy_timer_fn == NULL);
+  easy_timer_fn = fn;
+  easy_timer_expires = sim_now + delay;
+  return 1;
+}
+
+void sim_tick(void) {
+  sim_now++;
+  for (int i = 0; i < SIM_TIMERS; i++) {
+    if (timers[i].active && timers[i].expires <= sim_now) {
+      timers[i].active = false;
+      ke_msg_send_basic(timers[i].id, TASK_UART, TASK_UART);
+    }
+  }
+  if (easy_timer_fn != NULL && easy_timer_expires <= sim_now) {
+    void (*fn)(void) = easy_timer_fn;
+    easy_timer_fn = NULL;
+    fn();
+  }
+}
+
+// UART
+
+uart_t *const UART1 = NULL;
+
+static uart_cb_t rx_cb = NULL;
+static uart_cb_t tx_cb = NULL;
+static bool rx_intr_enabled = true;
+// RX FIFO
+static uint8_t rx_fifo[64];
+static uint16_t rx_fifo_rd = 0;
+static uint16_t rx_fifo_wr = 0;
+// Transfer in progress
+static const uint8_t *tx_data = NULL;
+static uint16_t tx_len = 0;
+
+// Bytes of sim_rx_polled() that didn't arrive or weren't read yet
+#define SIM_POLLED_MAX 8
+static struct {
+  uint8_t data[256];
+  uint16_t len;
+  uint16_t rd;
+  uint32_t at_us;
+} polled[SIM_POLLED_MAX];
+static int polled_len = 0;
+
+void uart_register_rx_cb(uart_t *uart, uart_cb_t cb) { rx_cb = cb; }
+void uart_register_tx_cb(uart_t *uart, uart_cb_t cb) { tx_cb = cb; }
+void uart_receive(uart_t *uart, uint8_t *data, uint16_t len, UART_OP_CFG op) {}
+void uart_baudrate_setf(uart_t *uart, UART_BAUDRATE rate) {
+  sim_baud_rate = rate;
+}
+void uart_wait_tx_finish(uart_t *uart) {}
+
+void uart_rxdata_intr_setf(uart_t *uart, UART_BIT enable) {
+  rx_intr_enabled = enable == UART_BIT_EN;
+}
+
+uint8_t uart_data_ready_getf(uart_t *uart) {
+  return rx_fifo_rd != rx_fifo_wr ||
+         (polled_len > 0 && polled[0].at_us <= sim_us);
+}
+
+uint8_t uart_read_rbr(uart_t *uart) {
+  if (rx_fifo_rd != rx_fifo_wr) {
+    return rx_fifo[rx_fifo_rd++];
+  }
+  ASSERT_ERROR(polled_len > 0 && polled[0].at_us <= sim_us);
+  uint8_t byte = polled[0].data[polled[0].rd++];
+  if (polled[0].rd == polled[0].len) {
+    polled_len--;
+    memmove(&polled[0], &polled[1], polled_len * sizeof(polled[0]));
+  }
+  return byte;
+}
+
+void sim_rx_polled(const uint8_t *data, uint16_t len, uint32_t at_us) {
+  ASSERT_ERROR(polled_len < SIM_POLLED_MAX);
+  ASSERT_ERROR(len > 0 && len <= sizeof(polled[0].data));
+  memcpy(polled[polled_len].data, data, len);
+  polled[polled_len].len = len;
+  polled[polled_len].rd = 0;
+  polled[polled_len].at_us = at_us;
+  polled_len++;
+}
+
+void uart_send(uart_t *uart, const uint8_t *data, uint16_t len,
+               UART_OP_CFG op) {
+  if (op == UART_OP_BLOCKING) {
+    ASSERT_ERROR(sim_blocking_tx != NULL);
+    sim_blocking_tx(data, len);
+    return;
+  }
+  ASSERT_ERROR(tx_data == NULL);
+  tx_data = data;
+  tx_len = len;
+}
+
+// DMA channel receiving from the UART. It takes every byte out of the FIFO
+// right away, in a loop through its buffer.
+static dma_cfg_t dma_cfg;
+static bool dma_enabled = false;
+// Bytes moved since the last time the buffer was full, and where the next
+// interrupt is raised
+static uint16_t dma_idx = 0;
+static uint16_t dma_int_ix = 0;
+
+void dma_channel_initialize(DMA_ID channel_number, dma_cfg_t *dma_cfg_in) {
+  ASSERT_ERROR(dma_cfg_in->circular == DMA_MODE_CIRCULAR);
+  dma_cfg = *dma_cfg_in;
+  dma_idx = 0;
+  dma_int_ix = dma_cfg.irq_nr_of_trans;
+}
+
+void dma_channel_enable(DMA_ID channel_number, DMA_STATE_CFG dma_state) {
+  dma_enabled = dma_state == DMA_STATE_ENABLED;
+}
+
+uint16_t dma_channel_transfered_bytes(DMA_ID channel_number) {
+  return dma_idx;
+}
+
+void dma_channel_update_int_ix(DMA_ID channel_number, uint16_t int_ix) {
+  dma_int_ix = int_ix;
+}
+
+// Moves at most `n` bytes out of the RX FIFO
+static void sim_dma_move(uint16_t n) {
+  uint8_t *dst = (uint8_t *)dma_cfg.dst_address;
+  for (; n > 0 && rx_fifo_rd != rx_fifo_wr; n--) {
+    dst[dma_idx++] = rx_fifo[rx_fifo_rd++];
+    bool irq = dma_idx == dma_int_ix;
+    if (dma_idx == dma_cfg.length) {
+      dma_idx = 0;
+    }
+    if (irq) {
+      ASSERT_ERROR(irq_disabled == 0);
+      dma_cfg.cb(dma_cfg.user_data, dma_int_ix);
+    }
+  }
+}
+
+void sim_rx(const uint8_t *data, uint16_t len, uint16_t fifo) {
+  ASSERT_ERROR(fifo > 0 && fifo <= sizeof(rx_fifo));
+  uint16_t offset = 0;
+  while (offset < len) {
+    // Bytes the interrupt left in the FIFO stay in front
+    uint16_t left = rx_fifo_wr - rx_fifo_rd;
+    memmove(rx_fifo, &rx_fifo[rx_fifo_rd], left);
+    rx_fifo_rd = 0;
+    // `fifo` may be smaller than in the call that left them
+    uint16_t room = left < fifo ? fifo - left : 0;
+    uint16_t n = len - offset;
+    if (n > room) {
+      n = room;
+    }
+    memcpy(&rx_fifo[left], &data[offset], n);
+    rx_fifo_wr = left + n;
+    offset += n;
+    if (dma_enabled) {
+      // The interrupt of the FIFO comes before the DMA has taken the last byte
+      sim_dma_move(rx_fifo_wr - rx_fifo_rd - 1);
+      if (rx_intr_enabled) {
+        ASSERT_ERROR(irq_disabled == 0);
+        rx_cb(rx_fifo_wr - rx_fifo_rd);
+      }
+      sim_dma_move(1);
+      continue;
+    }
+    if (!rx_intr_enabled) {
+      // Hardware flow control holds the MCU back until TASK_UART makes room
+      sim_run();
+      ASSERT_ERROR(rx_intr_enabled);
+    }
+    ASSERT_ERROR(irq_disabled == 0);
+    rx_cb(rx_fifo_wr - rx_fifo_rd);
+  }
+}
+
+uint16_t sim_tx_complete(uint8_t *out, uint16_t cap) {
+  if (tx_data == NULL) {
+    return 0;
+  }
+  uint16_t len = tx_len;
+  memcpy(out, tx_data, len < cap ? len : cap);
+  tx_data = NULL;
+  ASSERT_ERROR(irq_disabled == 0);
+  tx_cb(len);
+  return len;
+}
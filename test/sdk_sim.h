@@ -0,0 +1,76 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Emulation of the kernel, the UART with its RX DMA and the BLE clock of the
+// Dialog SDK, so that uart_task.c can be run against a model of the MCU on the
+// host. There is a single task, TASK_UART, messages to the other tasks go to
+// sim_app_msg.
+
+#ifndef SDK_SIM_H
+#define SDK_SIM_H
+
+#include <ke_msg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <uart.h>
+
+/// Called with the messages sent to tasks other than TASK_UART, defined by the
+/// test. The message is freed afterwards.
+void sim_app_msg(ke_msg_id_t id, void *param);
+
+/// Handles the queued messages, returns how many
+int sim_run(void);
+
+/// Advances the time by 10ms and fires the timers that expired
+void sim_tick(void);
+
+/// The MCU sends `data`. The RX interrupt gets it in pieces of at most `fifo`
+/// bytes, TASK_UART runs when the interrupt turned itself off. Once the DMA is
+/// enabled it takes the bytes instead and the interrupt only fires while it is
+/// on.
+void sim_rx(const uint8_t *data, uint16_t len, uint16_t fifo);
+
+/// Completes the transfer in progress, copying at most `cap` bytes of it to
+/// `out`. Returns the length of the transfer, 0 if there was none.
+uint16_t sim_tx_complete(uint8_t *out, uint16_t cap);
+
+/// The MCU sends `data` while the chip polls the RX FIFO, as it does at boot.
+/// The bytes arrive in order, those of this call once sim_us has reached
+/// `at_us`.
+void sim_rx_polled(const uint8_t *data, uint16_t len, uint32_t at_us);
+
+/// Called with the bytes of a blocking uart_send(), defined by tests that use
+/// it
+extern void (*sim_blocking_tx)(const uint8_t *data, uint16_t len);
+
+/// Called where an interrupt may preempt TASK_UART, for now whenever a message
+/// is freed with the interrupts enabled. Not called again from within itself.
+extern void (*sim_preempt)(void);
+
+/// Messages allocated and not yet freed
+extern long sim_live_msgs;
+/// Messages freed with the interrupts disabled
+extern long sim_masked_frees;
+/// Time in units of 10ms
+extern uint32_t sim_now;
+/// Time spent in arch_asm_delay_us()
+extern uint32_t sim_us;
+/// Last baud rate set with uart_baudrate_setf()
+extern UART_BAUDRATE sim_baud_rate;
+/// ke_malloc() has no room while set
+extern bool sim_heap_full;
+/// What ke_get_mem_usage() reports
+extern uint16_t sim_mem_usage;
+
+#endif
@@ -0,0 +1,113 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Microbenchmark of the parser, built with and without SERIAL_LINK_SWAR.
+// Parses 64 byte BLE frames that arrive in 16 byte pieces through a 64 byte
+// ring, like from the RX FIFO, and prints the time per payload byte:
+//   ./serial_link_bench_swar [frames]
+//
+// The baseline feeds the same frames one byte at a time, so that there is
+// never more than one byte to scan or copy and every byte goes through the
+// state machine, like before the parser took payloads in runs. It also pays for
+// a parse call per byte, which the old parser didn't.
+//
+// Run by ctest with few frames, to check that what is parsed is what was
+// formatted. The numbers are from the host, where a branch predicted byte loop
+// is cheap. They don't carry over to the Cortex-M0+.
+
+#include <string.h>
+#include <time.h>
+
+#include "serial_link.h"
+#include "test.h"
+
+// Same default as in serial_link.c
+#ifndef SERIAL_LINK_SWAR
+#define SERIAL_LINK_SWAR 1
+#endif
+
+#define PAYLOAD_LEN 64
+
+static uint8_t rx_buf[64];
+static struct ring rx = RING_INIT(rx_buf);
+
+// Formats `frames` frames with the payload from `fill` and parses them back,
+// `chunk_len` bytes at a time. Returns the time spent parsing in ns.
+static double bench(uint32_t frames, uint8_t (*fill)(void),
+                    uint16_t chunk_len) {
+  static uint8_t stream[SERIAL_LINK_FRAME_LEN_MAX(PAYLOAD_LEN) * 16];
+  uint8_t payload[PAYLOAD_LEN];
+  uint8_t frame[PAYLOAD_LEN];
+  struct sl_parser parser;
+  sl_parser_init(&parser, frame, sizeof(frame), NULL);
+  double ns = 0;
+
+  for (uint32_t done = 0; done < frames; done += 16) {
+    // 16 frames with the same payload, formatted back to back
+    for (size_t i = 0; i < sizeof(payload); i++) {
+      payload[i] = fill();
+    }
+    uint16_t stream_len = 0;
+    for (int i = 0; i < 16; i++) {
+      stream_len += serial_link_format(&stream[stream_len],
+                                       sizeof(stream) - stream_len,
+                                       SL_PT_BLE_DATA, payload, PAYLOAD_LEN);
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint16_t offset = 0;
+    int parsed = 0;
+    while (offset < stream_len || ring_len(&rx) > 0) {
+      uint8_t *dst;
+      uint16_t len = MIN(ring_reserve(&rx, &dst), chunk_len);
+      len = MIN(len, stream_len - offset);
+      memcpy(dst, &stream[offset], len);
+      ring_commit(&rx, len);
+      offset += len;
+      enum sl_status res;
+      while ((res = serial_link_parse_packet_ring(&parser, &rx)) != SL_NONE) {
+        CHECK(res == SL_PACKET_TYPE_BLE_DATA);
+        CHECK(sl_parser_payload_len(&parser) == PAYLOAD_LEN);
+        CHECK(memcmp(sl_parser_payload(&parser), payload, PAYLOAD_LEN) == 0);
+        parsed++;
+      }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    CHECK(parsed == 16);
+    ns += (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+  }
+  return ns;
+}
+
+// Typical BLE data, few bytes need escaping
+static uint8_t fill_random(void) { return test_rand() & 0xff; }
+
+// Worst case, every byte is SOF or ESCAPE and escaped
+static uint8_t fill_special(void) { return (test_rand() & 1) ? 0x7e : 0x7d; }
+
+int main(int argc, char **argv) {
+  uint32_t frames = argc > 1 ? strtoul(argv[1], NULL, 0) : 100000;
+  frames = (frames + 15) / 16 * 16;
+  double bytes = (double)frames * PAYLOAD_LEN;
+  printf("SERIAL_LINK_SWAR=%d, %u frames of %d bytes\n", SERIAL_LINK_SWAR,
+         frames, PAYLOAD_LEN);
+  printf("  random payload:  %.2f ns/byte, %.2f ns/byte one byte at a time\n",
+         bench(frames, fill_random, 16) / bytes,
+         bench(frames, fill_random, 1) / bytes);
+  printf("  escaped payload: %.2f ns/byte, %.2f ns/byte one byte at a time\n",
+         bench(frames, fill_special, 16) / bytes,
+         bench(frames, fill_special, 1) / bytes);
+  return 0;
+}
@@ -0,0 +1,212 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Runs the blocking exchange at boot, the HELLO, the baud rate upgrade and the
+// loads, against a model of the MCU that loses or delays some of its answers.
+// Bytes sent at a baud rate the other side doesn't use are lost.
+
+#include <string.h>
+
+#include "sdk_sim.h"
+#include "serial_link.h"
+#include "test.h"
+
+// Time from a request until the MCU has answered it
+#define MCU_LATENCY_US 200
+// A late answer to a load, after the chip has asked again
+#define MCU_LATE_US 600000
+
+static const UART_BAUDRATE baud_rates[] = {
+    [SL_BAUD_RATE_115200] = UART_BAUDRATE_115200,
+    [SL_BAUD_RATE_460800] = UART_BAUDRATE_460800,
+    [SL_BAUD_RATE_921600] = UART_BAUDRATE_921600,
+    [SL_BAUD_RATE_1000000] = UART_BAUDRATE_1000000,
+};
+
+static const struct sl_caps caps = {
+    .version = SL_PROTOCOL_VERSION,
+    .frame_max = 95,
+    .window = 8,
+    .framings = SL_FRAMING_MASK(SL_FRAMING_ESCAPE) |
+                SL_FRAMING_MASK(SL_FRAMING_COBS),
+    .baud_rates = SL_BAUD_RATE_MASK(SL_BAUD_RATE_115200) |
+                  SL_BAUD_RATE_MASK(SL_BAUD_RATE_460800) |
+                  SL_BAUD_RATE_MASK(SL_BAUD_RATE_921600) |
+                  SL_BAUD_RATE_MASK(SL_BAUD_RATE_1000000),
+    .compressions = SL_COMPRESSION_MASK(SL_COMPRESSION_RLE),
+};
+
+static const uint8_t irk[16] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66,
+                                0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc,
+                                0xdd, 0xee, 0xf0, 0x0f};
+static const uint8_t address[6] = {0xc0, 0xff, 0xee, 0x12, 0x34, 0x56};
+
+// MCU side
+static struct sl_parser mcu_parser;
+static uint8_t mcu_frame[64];
+// The MCU knows the HELLO
+static bool mcu_hello = false;
+static uint8_t mcu_baud = SL_BAUD_RATE_115200;
+// After switching the MCU falls back unless a frame arrives before this
+static bool mcu_switched = false;
+static uint32_t mcu_deadline_us = 0;
+// The answer with this number is lost
+static int mcu_answers = 0;
+static int mcu_lose = -1;
+// No answer is sent before this
+static uint32_t mcu_busy_until_us = 0;
+// Frames received, by command, and bytes of the chip the MCU couldn't read
+static int mcu_requests[256];
+static int mcu_garbled = 0;
+
+void sim_app_msg(ke_msg_id_t id, void *param) {}
+
+static void mcu_answer(uint8_t cmd, const uint8_t *payload, uint16_t len) {
+  if (mcu_answers++ == mcu_lose || sim_baud_rate != baud_rates[mcu_baud]) {
+    return;
+  }
+  const struct sl_iov iov[] = {{&cmd, 1}, {payload, len}};
+  uint8_t frame[SERIAL_LINK_FRAME_LEN_MAX(32)];
+  uint16_t frame_len = serial_link_format_iov(frame, sizeof(frame),
+                                              SL_PT_CTRL_DATA, iov, 2);
+  uint32_t at = sim_us + MCU_LATENCY_US;
+  sim_rx_polled(frame, frame_len, at > mcu_busy_until_us ? at
+                                                         : mcu_busy_until_us);
+}
+
+static void mcu_rx(const uint8_t *data, uint16_t len) {
+  if (mcu_switched && sim_us >= mcu_deadline_us) {
+    mcu_baud = SL_BAUD_RATE_115200;
+    mcu_switched = false;
+  }
+  if (sim_baud_rate != baud_rates[mcu_baud]) {
+    mcu_garbled++;
+    if (mcu_switched) {
+      mcu_baud = SL_BAUD_RATE_115200;
+      mcu_switched = false;
+    }
+    return;
+  }
+  mcu_switched = false;
+
+  // The framing is shared with the chip, which switched after the HELLO
+  if (mcu_parser.framing != serial_link_framing()) {
+    sl_parser_init(&mcu_parser, mcu_frame, sizeof(mcu_frame), NULL);
+  }
+  uint8_t buf[64];
+  CHECK(len <= sizeof(buf));
+  memcpy(buf, data, len);
+  uint16_t buf_len = len;
+  CHECK(serial_link_parse_packet(&mcu_parser, buf, &buf_len) ==
+        SL_PACKET_TYPE_CTRL_DATA);
+  const uint8_t *payload = sl_parser_payload(&mcu_parser);
+  uint8_t cmd = payload[0];
+  mcu_requests[cmd]++;
+  switch (cmd) {
+  case SL_CTRL_CMD_HELLO:
+    if (mcu_hello) {
+      const uint8_t hello[] = {
+          caps.version,      caps.frame_max & 0xff, caps.frame_max >> 8,
+          caps.window,       caps.framings,         caps.baud_rates,
+          caps.compressions,
+      };
+      mcu_answer(cmd, hello, sizeof(hello));
+    }
+    break;
+  case SL_CTRL_CMD_BAUD_RATE:
+    mcu_answer(cmd, &payload[1], 1);
+    mcu_baud = payload[1];
+    mcu_switched = true;
+    mcu_deadline_us = sim_us + MCU_LATENCY_US + SL_BAUD_RATE_TIMEOUT_US;
+    break;
+  case SL_CTRL_CMD_IRK:
+    mcu_answer(cmd, irk, sizeof(irk));
+    break;
+  case SL_CTRL_CMD_IDENTITY_ADDRESS:
+    mcu_answer(cmd, address, sizeof(address));
+    break;
+  default:
+    CHECK(false);
+  }
+}
+
+static void check_irk(void) {
+  uint8_t buf[sizeof(irk)];
+  CHECK(sl_irk_load(buf, sizeof(buf)) == sizeof(irk));
+  CHECK(memcmp(buf, irk, sizeof(irk)) == 0);
+}
+
+static void check_address(void) {
+  uint8_t buf[sizeof(address)];
+  CHECK(sl_identity_address_load(buf, sizeof(buf)) == sizeof(address));
+  CHECK(memcmp(buf, address, sizeof(address)) == 0);
+}
+
+// The answer to the first or the second baud rate request is lost. The chip
+// stays at 115200 and waits until the MCU has fallen back before it loads.
+static void baud_rate_fallback(int lost) {
+  memset(mcu_requests, 0, sizeof(mcu_requests));
+  mcu_lose = mcu_answers + lost;
+  sl_baud_rate_upgrade(&caps);
+  CHECK(serial_link_baud_rate() == SL_BAUD_RATE_115200);
+  CHECK(mcu_requests[SL_CTRL_CMD_BAUD_RATE] == lost + 1);
+  check_irk();
+  CHECK(mcu_requests[SL_CTRL_CMD_IRK] == 1);
+  CHECK(mcu_baud == SL_BAUD_RATE_115200);
+  CHECK(mcu_garbled == 0);
+}
+
+int main(void) {
+  sl_parser_init(&mcu_parser, mcu_frame, sizeof(mcu_frame), NULL);
+  sim_blocking_tx = mcu_rx;
+
+  // MCU firmware from before the HELLO doesn't answer it, nothing changes
+  sl_hello(&caps);
+  CHECK(sl_peer_caps.version == 0);
+  CHECK(serial_link_framing() == SL_FRAMING_ESCAPE);
+  sl_baud_rate_upgrade(&caps);
+  CHECK(mcu_requests[SL_CTRL_CMD_BAUD_RATE] == 0);
+  CHECK(serial_link_baud_rate() == SL_BAUD_RATE_115200);
+
+  mcu_hello = true;
+  sl_hello(&caps);
+  CHECK(sl_peer_caps.version == SL_PROTOCOL_VERSION);
+  CHECK(sl_peer_caps.baud_rates == caps.baud_rates);
+  CHECK(serial_link_framing() == SL_FRAMING_COBS);
+  CHECK(serial_link_compression());
+
+  baud_rate_fallback(0);
+  baud_rate_fallback(1);
+
+  // A lost answer to a load is asked for again
+  memset(mcu_requests, 0, sizeof(mcu_requests));
+  mcu_lose = mcu_answers;
+  check_irk();
+  CHECK(mcu_requests[SL_CTRL_CMD_IRK] == 2);
+
+  // A late one comes after the chip asked again, the answer to that is
+  // skipped by the next load
+  memset(mcu_requests, 0, sizeof(mcu_requests));
+  mcu_busy_until_us = sim_us + MCU_LATE_US;
+  check_irk();
+  CHECK(mcu_requests[SL_CTRL_CMD_IRK] == 2);
+  check_address();
+
+  sl_baud_rate_upgrade(&caps);
+  CHECK(serial_link_baud_rate() == SL_BAUD_RATE_1000000);
+  CHECK(mcu_baud == SL_BAUD_RATE_1000000);
+  check_irk();
+  CHECK(mcu_garbled == 0);
+  return 0;
+}
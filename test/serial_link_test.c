@@ -0,0 +1,274 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Round trips of the framings and of the run-length compression of control
+// payloads, on a corpus of random, low entropy and bond database shaped data
+
+#include <string.h>
+
+#include "serial_link.h"
+#include "test.h"
+
+#define PAYLOAD_MAX 700
+// Size of struct bond_db
+#define BOND_DB_LEN 644
+
+// Payloads that stress the framings: random, zeros and SOF/ESCAPE for both,
+// and runs without zeros longer than a COBS block
+static uint16_t corpus_fill(uint8_t *buf, uint16_t cap) {
+  uint16_t len = test_rand() % (cap + 1);
+  switch (test_rand() % 5) {
+  case 0:
+    test_rand_fill(buf, len);
+    break;
+  case 1:
+    memset(buf, 0, len);
+    break;
+  case 2:
+    for (uint16_t i = 0; i < len; i++) {
+      buf[i] = 0x7d + (test_rand() & 1);
+    }
+    break;
+  case 3: {
+    // Around multiples of the 254 bytes of a full COBS block
+    uint16_t blocks = 1 + test_rand() % 2;
+    len = blocks * 254 - 1 + test_rand() % 3;
+    len = MIN(len, cap);
+    for (uint16_t i = 0; i < len; i++) {
+      buf[i] = 1 + test_rand() % 255;
+    }
+  } break;
+  default: {
+    // Few distinct values in runs of random length, like mostly empty
+    // structs
+    uint8_t alphabet = 1 + test_rand() % 4;
+    uint16_t i = 0;
+    while (i < len) {
+      uint16_t run = 1 + test_rand() % 200;
+      run = MIN(run, len - i);
+      memset(&buf[i], test_rand() % alphabet, run);
+      i += run;
+    }
+  } break;
+  }
+  return len;
+}
+
+// A frame in the corpus
+struct frame {
+  uint8_t type;
+  bool seq;
+  uint8_t seq_nr;
+  uint8_t ack;
+  uint8_t payload[300];
+  uint16_t payload_len;
+  uint8_t wire[SERIAL_LINK_FRAME_LEN_MAX(300)];
+  uint16_t wire_len;
+};
+
+static const uint8_t frame_types[] = {SL_PT_BLE_DATA, SL_PT_CTRL_DATA,
+                                      SL_PT_PING};
+
+static void frame_make(struct frame *f) {
+  f->type = frame_types[test_rand() % sizeof(frame_types)];
+  f->seq = test_rand() % 4 == 0;
+  f->seq_nr = test_rand() & 0xff;
+  f->ack = test_rand() & 0xff;
+  f->payload_len = corpus_fill(f->payload, sizeof(f->payload));
+  if (f->seq) {
+    struct sl_iov iov = {f->payload, f->payload_len};
+    f->wire_len = serial_link_format_seq(f->wire, sizeof(f->wire), f->type,
+                                         f->seq_nr, f->ack, &iov, 1);
+  } else {
+    f->wire_len = serial_link_format(f->wire, sizeof(f->wire), f->type,
+                                     f->payload, f->payload_len);
+  }
+  CHECK(f->wire_len > 0);
+  CHECK(f->wire_len <= serial_link_frame_len_max(f->payload_len));
+  CHECK(f->wire_len <= SERIAL_LINK_FRAME_LEN_MAX(f->payload_len));
+
+  // Formatting piece by piece gives the same bytes
+  struct sl_stream s;
+  if (f->seq) {
+    sl_stream_init_seq(&s, f->type, f->seq_nr, f->ack, f->payload,
+                       f->payload_len);
+  } else {
+    sl_stream_init(&s, f->type, f->payload, f->payload_len);
+  }
+  static uint8_t streamed[sizeof(f->wire)];
+  uint16_t streamed_len = 0;
+  while (!sl_stream_done(&s)) {
+    uint16_t piece = 1 + test_rand() % 32;
+    piece = MIN(piece, sizeof(streamed) - streamed_len);
+    streamed_len += sl_stream_read(&s, &streamed[streamed_len], piece);
+  }
+  CHECK(streamed_len == f->wire_len);
+  CHECK(memcmp(streamed, f->wire, f->wire_len) == 0);
+}
+
+static void frame_check(const struct sl_parser *p, enum sl_status res,
+                        const struct frame *f) {
+  CHECK(res != SL_NONE && res != SL_ERR);
+  CHECK(sl_packet_type_plain(sl_parser_type(p)) == f->type);
+  CHECK(sl_packet_type_is_seq(sl_parser_type(p)) == f->seq);
+  if (f->seq) {
+    CHECK(sl_parser_seq(p) == f->seq_nr);
+    CHECK(sl_parser_ack(p) == f->ack);
+  }
+  CHECK(sl_parser_payload_len(p) == f->payload_len);
+  CHECK(memcmp(sl_parser_payload(p), f->payload, f->payload_len) == 0);
+}
+
+// Frames back to back, the middle one with a flipped bit, fed through a small
+// ring in random pieces. The intact frames arrive, the corrupted one at most
+// as errors.
+static void test_framing(enum sl_framing framing) {
+  serial_link_set_framing(framing);
+  static uint8_t parsed[512];
+  struct sl_parser parser;
+  sl_parser_init(&parser, parsed, sizeof(parsed), NULL);
+  static uint8_t rx_buf[64];
+  struct ring rx = RING_INIT(rx_buf);
+  static struct frame frames[3];
+
+  for (int n = 0; n < 5000; n++) {
+    for (int i = 0; i < 3; i++) {
+      frame_make(&frames[i]);
+      if (framing == SL_FRAMING_COBS) {
+        // Zeros only delimit frames
+        CHECK(frames[i].wire[0] == 0);
+        CHECK(frames[i].wire[frames[i].wire_len - 1] == 0);
+        CHECK(memchr(&frames[i].wire[1], 0, frames[i].wire_len - 2) == NULL);
+      }
+    }
+    bool corrupt = n % 2 == 1;
+    if (corrupt) {
+      struct frame *f = &frames[1];
+      f->wire[1 + test_rand() % (f->wire_len - 2)] ^= 1 << (test_rand() % 8);
+    }
+
+    int next = 0;
+    for (int i = 0; i < 3; i++) {
+      uint16_t offset = 0;
+      while (offset < frames[i].wire_len) {
+        uint8_t *dst;
+        // The random piece is drawn first, MIN evaluates its arguments twice
+        uint16_t len = 1 + test_rand() % 24;
+        len = MIN(len, ring_reserve(&rx, &dst));
+        len = MIN(len, frames[i].wire_len - offset);
+        memcpy(dst, &frames[i].wire[offset], len);
+        ring_commit(&rx, len);
+        offset += len;
+        enum sl_status res;
+        while ((res = serial_link_parse_packet_ring(&parser, &rx)) !=
+               SL_NONE) {
+          if (corrupt && next == 1 && res == SL_ERR) {
+            continue;
+          }
+          if (corrupt && next == 1 && i == 2) {
+            next = 2;
+          }
+          CHECK(next < 3);
+          frame_check(&parser, res, &frames[next++]);
+        }
+      }
+    }
+    CHECK(next == 3 || (corrupt && next == 2));
+    // Everything fed was parsed
+    CHECK(ring_len(&rx) == 0);
+  }
+
+  // The linear buffer parser of the boot reads
+  for (int n = 0; n < 1000; n++) {
+    frame_make(&frames[0]);
+    static uint8_t buf[sizeof(frames[0].wire)];
+    memcpy(buf, frames[0].wire, frames[0].wire_len);
+    uint16_t buf_len = frames[0].wire_len;
+    sl_parser_init(&parser, parsed, sizeof(parsed), NULL);
+    frame_check(&parser, serial_link_parse_packet(&parser, buf, &buf_len),
+                &frames[0]);
+  }
+  serial_link_set_framing(SL_FRAMING_ESCAPE);
+}
+
+static void rle_round_trip(const uint8_t *in, uint16_t len) {
+  static uint8_t encoded[PAYLOAD_MAX + PAYLOAD_MAX / 128 + 1];
+  static uint8_t decoded[PAYLOAD_MAX];
+  uint16_t encoded_len = sl_rle_encode(NULL, 0, in, len);
+  CHECK(encoded_len <= len + (len + 127) / 128);
+  CHECK(sl_rle_encode(encoded, sizeof(encoded), in, len) == encoded_len);
+  if (len > 0) {
+    // Doesn't write past out_len
+    CHECK(sl_rle_encode(encoded, encoded_len - 1, in, len) == 0);
+  }
+  CHECK(sl_rle_decode(NULL, 0, encoded, encoded_len) == len);
+  CHECK(sl_rle_decode(decoded, len, encoded, encoded_len) == len);
+  CHECK(memcmp(decoded, in, len) == 0);
+  if (len > 0) {
+    CHECK(sl_rle_decode(decoded, len - 1, encoded, encoded_len) == -1);
+  }
+  if (encoded_len > 1) {
+    CHECK(sl_rle_decode(decoded, len, encoded, encoded_len - 1) != len);
+  }
+}
+
+static void test_rle_corpus(void) {
+  static uint8_t buf[PAYLOAD_MAX];
+  for (int n = 0; n < 20000; n++) {
+    rle_round_trip(buf, corpus_fill(buf, sizeof(buf)));
+  }
+}
+
+// The bond database is zeros but for the bonded slots
+static void test_rle_bond_db(void) {
+  static uint8_t db[BOND_DB_LEN];
+  memset(db, 0, sizeof(db));
+  rle_round_trip(db, sizeof(db));
+  CHECK(sl_rle_encode(NULL, 0, db, sizeof(db)) <= 10);
+
+  // Header and one bonded slot
+  test_rand_fill(db, 12 + 126);
+  rle_round_trip(db, sizeof(db));
+  CHECK(sl_rle_encode(NULL, 0, db, sizeof(db)) <= 150);
+
+  test_rand_fill(db, sizeof(db));
+  rle_round_trip(db, sizeof(db));
+}
+
+// Garbage decodes to an error or to something that fits
+static void test_rle_malformed(void) {
+  static uint8_t in[64];
+  static uint8_t out[300 + 16];
+  for (int n = 0; n < 100000; n++) {
+    uint16_t len = test_rand() % sizeof(in);
+    test_rand_fill(in, len);
+    memset(out, 0xa5, sizeof(out));
+    int32_t decoded = sl_rle_decode(out, 300, in, len);
+    CHECK(decoded >= -1 && decoded <= 300);
+    for (size_t i = 300; i < sizeof(out); i++) {
+      CHECK(out[i] == 0xa5);
+    }
+    int32_t counted = sl_rle_decode(NULL, 0, in, len);
+    CHECK(decoded == -1 || counted == decoded);
+  }
+}
+
+int main(void) {
+  test_framing(SL_FRAMING_ESCAPE);
+  test_framing(SL_FRAMING_COBS);
+  test_rle_corpus();
+  test_rle_bond_db();
+  test_rle_malformed();
+  return 0;
+}
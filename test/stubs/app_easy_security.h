@@ -0,0 +1,46 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Host stand-in for the app layer of the Dialog SDK, only what the sources
+// under test use
+
+#ifndef APP_EASY_SECURITY_H
+#define APP_EASY_SECURITY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "gapc_task.h"
+
+#define KEY_LEN 16
+
+void app_easy_security_tk_exch(uint8_t conidx, uint8_t *key, uint8_t length,
+                               bool accept);
+
+void app_easy_gap_disconnect(uint8_t conidx);
+void app_easy_gap_advertise_stop(void);
+
+struct app_device_info {
+  struct app_device_name dev_name;
+};
+
+extern struct app_device_info device_info;
+
+typedef uint8_t timer_hnd;
+#define EASY_TIMER_INVALID_TIMER 0
+
+// Delay in units of 10ms
+timer_hnd app_easy_timer(uint32_t delay, void (*fn)(void));
+
+#endif
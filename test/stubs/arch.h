@@ -0,0 +1,64 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Host stand-in for the header of the Dialog SDK, only what the sources under
+// test use. The interrupt controller and SysTick are emulated by sdk_sim.c.
+
+#ifndef ARCH_H
+#define ARCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "arch_system.h"
+
+#define __ARRAY_EMPTY
+#define ARRAY_LEN(array) (sizeof(array) / sizeof((array)[0]))
+#define __SECTION_ZERO(name)
+
+typedef enum {
+  DMA_IRQn = 5,
+  UART_IRQn = 8,
+  UART2_IRQn = 9,
+} IRQn_Type;
+
+void NVIC_DisableIRQ(IRQn_Type irq);
+void NVIC_EnableIRQ(IRQn_Type irq);
+// Priorities are ignored
+#define NVIC_SetPriority(irq, priority) ((void)(irq), (void)(priority))
+#define NVIC_GetPriority(irq) ((void)(irq), 2U)
+
+typedef struct {
+  volatile uint32_t CTRL;
+  volatile uint32_t LOAD;
+  volatile uint32_t VAL;
+  volatile uint32_t CALIB;
+} SysTick_Type;
+
+extern SysTick_Type sim_systick;
+#define SysTick (&sim_systick)
+#define SysTick_CTRL_ENABLE_Msk 1UL
+#define SysTick_CTRL_CLKSOURCE_Msk 4UL
+#define SysTick_LOAD_RELOAD_Msk 0xffffffUL
+
+// Writes to the registers are ignored
+#define SYS_CTRL_REG 0
+#define REMAP_ADR0 0x3
+#define SW_RESET 0x8000
+#define SetWord16(addr, value) ((void)(addr), (void)(value))
+#define GetWord16(addr) ((uint16_t)(addr))
+
+#endif
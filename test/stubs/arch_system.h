@@ -0,0 +1,38 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Host stand-in for the header of the Dialog SDK, only what the sources under
+// test use
+
+#ifndef ARCH_SYSTEM_H
+#define ARCH_SYSTEM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ASSERT_ERROR(cond)                                                     \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      fprintf(stderr, "%s:%d: assertion failed: %s\n", __FILE__, __LINE__,     \
+              #cond);                                                          \
+      abort();                                                                 \
+    }                                                                          \
+  } while (0)
+
+#define ASSERT_WARNING(cond) ASSERT_ERROR(cond)
+
+void arch_asm_delay_us(uint32_t us);
+
+#endif
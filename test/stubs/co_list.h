@@ -0,0 +1,65 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Host stand-in for the header of the Dialog SDK, only what the sources under
+// test use
+
+#ifndef CO_LIST_H
+#define CO_LIST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct co_list_hdr {
+  struct co_list_hdr *next;
+};
+
+struct co_list {
+  struct co_list_hdr *first;
+  struct co_list_hdr *last;
+};
+
+static inline void co_list_init(struct co_list *list) {
+  list->first = NULL;
+  list->last = NULL;
+}
+
+static inline bool co_list_is_empty(const struct co_list *list) {
+  return list->first == NULL;
+}
+
+static inline void co_list_push_back(struct co_list *list,
+                                     struct co_list_hdr *hdr) {
+  hdr->next = NULL;
+  if (list->first == NULL) {
+    list->first = hdr;
+  } else {
+    list->last->next = hdr;
+  }
+  list->last = hdr;
+}
+
+static inline struct co_list_hdr *co_list_pop_front(struct co_list *list) {
+  struct co_list_hdr *hdr = list->first;
+  if (hdr != NULL) {
+    list->first = hdr->next;
+  }
+  return hdr;
+}
+
+static inline struct co_list_hdr *co_list_pick(const struct co_list *list) {
+  return list->first;
+}
+
+#endif
@@ -0,0 +1,37 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Host stand-in for the header of the Dialog SDK, only what the sources under
+// test use
+
+#ifndef CUSTS1_TASK_H
+#define CUSTS1_TASK_H
+
+#include <stdint.h>
+
+#include "ke_msg.h"
+#include "rwip_config.h"
+
+enum {
+  CUSTS1_VAL_IND_REQ = KE_FIRST_MSG(TASK_ID_CUSTS1) + 4,
+};
+
+struct custs1_val_ind_req {
+  uint8_t conidx;
+  uint16_t handle;
+  uint16_t length;
+  uint8_t value[];
+};
+
+#endif
@@ -0,0 +1,70 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Host stand-in for the DMA driver of the Dialog SDK, only what the sources
+// under test use. The channel receiving from the UART is emulated by
+// sdk_sim.c.
+
+#ifndef DMA_H
+#define DMA_H
+
+#include <stdint.h>
+
+// Of datasheet.h, the address the DMA reads the received bytes from
+#define UART_RBR_THR_DLL_REG 0x50001000
+
+typedef enum {
+  DMA_CHANNEL_0 = 0,
+  DMA_CHANNEL_1 = 1,
+} DMA_ID;
+
+typedef enum { DMA_BW_BYTE = 0 } DMA_BW_CFG;
+typedef enum { DMA_IRQ_STATE_ENABLED = 1 } DMA_IRQ_CFG;
+typedef enum { DMA_DREQ_TRIGGERED = 1 } DMA_DREQ_CFG;
+typedef enum { DMA_INC_FALSE = 0, DMA_INC_TRUE = 1 } DMA_INC_CFG;
+typedef enum { DMA_MODE_CIRCULAR = 1 } DMA_MODE_CFG;
+typedef enum { DMA_PRIO_0 = 0 } DMA_PRIO_CFG;
+typedef enum { DMA_IDLE_INTERRUPTING_MODE = 1 } DMA_IDLE_CFG;
+typedef enum { DMA_INIT_AX_BX_AY_BY = 0 } DMA_INIT_CFG;
+typedef enum { DMA_TRIG_UART_RXTX = 2 } DMA_REQ_MUX_CFG;
+typedef enum { DMA_STATE_DISABLED = 0, DMA_STATE_ENABLED = 1 } DMA_STATE_CFG;
+
+typedef void (*dma_cb_t)(void *user_data, uint16_t len);
+
+typedef struct {
+  DMA_BW_CFG bus_width;
+  DMA_IRQ_CFG irq_enable;
+  uint16_t irq_nr_of_trans;
+  DMA_DREQ_CFG dreq_mode;
+  DMA_INC_CFG src_inc;
+  DMA_INC_CFG dst_inc;
+  DMA_MODE_CFG circular;
+  DMA_PRIO_CFG dma_prio;
+  DMA_IDLE_CFG dma_idle;
+  DMA_INIT_CFG dma_init;
+  DMA_REQ_MUX_CFG dma_req_mux;
+  uint32_t src_address;
+  // uint32_t on the chip, wide enough for a host pointer here
+  uintptr_t dst_address;
+  uint16_t length;
+  dma_cb_t cb;
+  void *user_data;
+} dma_cfg_t;
+
+void dma_channel_initialize(DMA_ID channel_number, dma_cfg_t *dma_cfg);
+void dma_channel_enable(DMA_ID channel_number, DMA_STATE_CFG dma_state);
+uint16_t dma_channel_transfered_bytes(DMA_ID channel_number);
+void dma_channel_update_int_ix(DMA_ID channel_number, uint16_t int_ix);
+
+#endif
@@ -0,0 +1,37 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Host stand-in for the header of the Dialog SDK, only what the sources under
+// test use
+
+#ifndef GAPC_TASK_H
+#define GAPC_TASK_H
+
+#include <stdint.h>
+
+#define GAP_INVALID_CONIDX 0xff
+#define GAP_MAX_NAME_SIZE 0x20
+#define GAP_AD_TYPE_COMPLETE_NAME 0x09
+#define SCAN_RSP_DATA_LEN 31
+
+struct gapc_connection_req_ind;
+struct gapc_disconnect_ind;
+struct gapc_bond_req_ind;
+
+struct app_device_name {
+  uint8_t length;
+  uint8_t name[GAP_MAX_NAME_SIZE];
+};
+
+#endif
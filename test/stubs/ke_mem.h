@@ -0,0 +1,29 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Host stand-in for the kernel heap of the Dialog SDK, see sdk_sim.c
+
+#ifndef KE_MEM_H
+#define KE_MEM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// KE_MEM_KE_MSG
+#include "ke_task.h"
+
+bool ke_check_malloc(uint32_t size, uint8_t type);
+void *ke_malloc(uint32_t size, uint8_t type);
+
+#endif
@@ -0,0 +1,71 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Host stand-in for the kernel messages of the Dialog SDK, see sdk_sim.c
+
+#ifndef KE_MSG_H
+#define KE_MSG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arch.h"
+#include "co_list.h"
+
+typedef uint16_t ke_msg_id_t;
+typedef uint16_t ke_task_id_t;
+typedef uint8_t ke_state_t;
+
+#define KE_BUILD_ID(type, index) ((ke_task_id_t)(((index) << 8) | (type)))
+#define KE_FIRST_MSG(task) ((ke_msg_id_t)((task) << 8))
+
+enum ke_msg_status_tag {
+  KE_MSG_CONSUMED = 0,
+  KE_MSG_NO_FREE,
+  KE_MSG_SAVED,
+};
+
+struct ke_msg {
+  struct co_list_hdr hdr;
+  ke_msg_id_t id;
+  ke_task_id_t dest_id;
+  ke_task_id_t src_id;
+  uint16_t param_len;
+  uint32_t param[];
+};
+
+static inline struct ke_msg *ke_param2msg(void const *param_ptr) {
+  return (struct ke_msg *)((uint8_t *)param_ptr -
+                           offsetof(struct ke_msg, param));
+}
+
+static inline void *ke_msg2param(struct ke_msg const *msg) {
+  return (void *)msg->param;
+}
+
+void *ke_msg_alloc(ke_msg_id_t id, ke_task_id_t dest_id, ke_task_id_t src_id,
+                   uint16_t param_len);
+void ke_msg_send(void const *param_ptr);
+void ke_msg_send_basic(ke_msg_id_t id, ke_task_id_t dest_id,
+                       ke_task_id_t src_id);
+void ke_msg_free(void const *param_ptr);
+
+#define KE_MSG_ALLOC_DYN(id, dest, src, param_str, length)                     \
+  (struct param_str *)ke_msg_alloc(id, dest, src,                              \
+                                   sizeof(struct param_str) + (length))
+#define KE_MSG_SEND(param_ptr) ke_msg_send(param_ptr)
+#define KE_MSG_SEND_BASIC(id, dest, src) ke_msg_send_basic(id, dest, src)
+#define KE_MSG_FREE(param_ptr) ke_msg_free(param_ptr)
+
+#endif
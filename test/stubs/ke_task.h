@@ -0,0 +1,66 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Host stand-in for the kernel tasks and timers of the Dialog SDK, see
+// sdk_sim.c
+
+#ifndef KE_TASK_H
+#define KE_TASK_H
+
+#include <stdint.h>
+
+#include "ke_msg.h"
+
+typedef int (*ke_msg_func_t)(ke_msg_id_t const msgid, void const *param,
+                             ke_task_id_t const dest_id,
+                             ke_task_id_t const src_id);
+
+struct ke_msg_handler {
+  ke_msg_id_t id;
+  ke_msg_func_t func;
+};
+
+struct ke_state_handler {
+  const struct ke_msg_handler *msg_table;
+  uint16_t msg_cnt;
+};
+
+#define KE_STATE_HANDLER(hdl)                                                  \
+  { hdl, sizeof(hdl) / sizeof(struct ke_msg_handler) }
+#define KE_STATE_HANDLER_NONE {NULL, 0}
+
+struct ke_task_desc {
+  const struct ke_state_handler *state_handler;
+  const struct ke_state_handler *default_handler;
+  ke_state_t *state;
+  uint16_t state_max;
+  uint16_t idx_max;
+};
+
+void ke_task_create(uint8_t task_type, struct ke_task_desc const *p_task_desc);
+void ke_state_set(ke_task_id_t const id, ke_state_t const state_id);
+ke_state_t ke_state_get(ke_task_id_t const id);
+
+// Delay in units of 10ms
+void ke_timer_set(ke_msg_id_t const timer_id, ke_task_id_t const task,
+                  uint32_t const delay);
+void ke_timer_clear(ke_msg_id_t const timer_id, ke_task_id_t const task);
+
+enum {
+  KE_MEM_KE_MSG = 2,
+};
+
+uint16_t ke_get_mem_usage(uint8_t type);
+
+#endif
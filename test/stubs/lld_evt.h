@@ -0,0 +1,25 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Host stand-in for the header of the Dialog SDK, see sdk_sim.c
+
+#ifndef LLD_EVT_H
+#define LLD_EVT_H
+
+#include <stdint.h>
+
+// BLE clock, 27 bits in units of 625us
+uint32_t lld_evt_time_get(void);
+
+#endif
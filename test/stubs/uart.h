@@ -0,0 +1,57 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Host stand-in for the UART driver of the Dialog SDK, see uart_stub.c and
+// sdk_sim.c
+
+#ifndef UART_H
+#define UART_H
+
+#include <stdint.h>
+
+typedef struct uart uart_t;
+extern uart_t *const UART1;
+
+typedef enum {
+  UART_OP_BLOCKING,
+  UART_OP_INTR,
+  UART_OP_DMA,
+} UART_OP_CFG;
+
+typedef enum {
+  UART_BAUDRATE_1000000 = 0x100,
+  UART_BAUDRATE_921600 = 0x101,
+  UART_BAUDRATE_460800 = 0x203,
+  UART_BAUDRATE_230400 = 0x405,
+  UART_BAUDRATE_115200 = 0x80b,
+} UART_BAUDRATE;
+
+typedef enum {
+  UART_BIT_DIS,
+  UART_BIT_EN,
+} UART_BIT;
+
+typedef void (*uart_cb_t)(uint16_t length);
+
+void uart_send(uart_t *uart, const uint8_t *data, uint16_t len, UART_OP_CFG op);
+void uart_receive(uart_t *uart, uint8_t *data, uint16_t len, UART_OP_CFG op);
+void uart_register_rx_cb(uart_t *uart, uart_cb_t cb);
+void uart_register_tx_cb(uart_t *uart, uart_cb_t cb);
+uint8_t uart_data_ready_getf(uart_t *uart);
+uint8_t uart_read_rbr(uart_t *uart);
+void uart_rxdata_intr_setf(uart_t *uart, UART_BIT enable);
+void uart_baudrate_setf(uart_t *uart, UART_BAUDRATE rate);
+void uart_wait_tx_finish(uart_t *uart);
+
+#endif
@@ -0,0 +1,34 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// UART without a peer, for tests of serial_link.c that don't use the blocking
+// reads and writes
+
+#include <arch_system.h>
+#include <stddef.h>
+#include <uart.h>
+
+uart_t *const UART1 = NULL;
+
+void uart_send(uart_t *uart, const uint8_t *data, uint16_t len,
+               UART_OP_CFG op) {}
+void uart_receive(uart_t *uart, uint8_t *data, uint16_t len, UART_OP_CFG op) {}
+void uart_register_rx_cb(uart_t *uart, uart_cb_t cb) {}
+void uart_register_tx_cb(uart_t *uart, uart_cb_t cb) {}
+uint8_t uart_data_ready_getf(uart_t *uart) { return 0; }
+uint8_t uart_read_rbr(uart_t *uart) { return 0; }
+void uart_rxdata_intr_setf(uart_t *uart, UART_BIT enable) {}
+void uart_baudrate_setf(uart_t *uart, UART_BAUDRATE rate) {}
+void uart_wait_tx_finish(uart_t *uart) {}
+void arch_asm_delay_us(uint32_t us) {}
@@ -0,0 +1,175 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Runs uart_task.c against an MCU that takes credits without the link layer
+// and sends frames the chip drops: with a bad crc, too long, of an unknown type
+// and without a payload. Nobody sends dropped frames again, so the chip has to
+// return their credits or the MCU runs dry.
+
+#include <custs1_task.h>
+#include <string.h>
+
+#include "sdk_sim.h"
+#include "serial_link.h"
+#include "test.h"
+#include "uart_task.h"
+
+#define FRAMES 5000
+// Iterations the MCU may wait for a credit
+#define STALL_MAX 100
+
+// MCU side
+static struct sl_parser mcu_parser;
+static uint8_t mcu_frame[512];
+static uint16_t mcu_limit = 0;
+static bool mcu_granted = false;
+static uint16_t mcu_sent = 0;
+
+// BLE data the chip indicated
+static uint32_t app_ble_next = 0;
+static uint32_t app_ble_frames = 0;
+
+void sim_app_msg(ke_msg_id_t id, void *param) {
+  CHECK(id == CUSTS1_VAL_IND_REQ);
+  struct custs1_val_ind_req *req = param;
+  CHECK(req->length == UART_BLE_PACKET_LEN);
+  // Frames are numbered, only the intact ones arrive
+  uint32_t n = req->value[0] | req->value[1] << 8 | req->value[2] << 16;
+  CHECK(n >= app_ble_next);
+  for (int i = 3; i < UART_BLE_PACKET_LEN; i++) {
+    CHECK(req->value[i] == (uint8_t)(n + i));
+  }
+  app_ble_next = n + 1;
+  app_ble_frames++;
+  uart_task_ble_confirmed();
+}
+
+// Reads what the chip sent and takes the credits it granted
+static void mcu_receive(void) {
+  static uint8_t buf[1024];
+  static uint16_t buf_len = 0;
+  uint16_t len;
+  while ((len = sim_tx_complete(&buf[buf_len], sizeof(buf) - buf_len)) > 0) {
+    CHECK(len <= sizeof(buf) - buf_len);
+    buf_len += len;
+    for (;;) {
+      enum sl_status res =
+          serial_link_parse_packet(&mcu_parser, buf, &buf_len);
+      if (res == SL_NONE) {
+        break;
+      }
+      CHECK(res != SL_ERR);
+      const uint8_t *payload = sl_parser_payload(&mcu_parser);
+      if (res == SL_PACKET_TYPE_CTRL_DATA &&
+          payload[0] == SL_CTRL_CMD_CREDIT) {
+        mcu_limit = payload[1] | payload[2] << 8;
+        mcu_granted = true;
+      }
+    }
+  }
+}
+
+// Flips a bit of the header, payload or crc, without making up a delimiter or
+// an escape, so that the frame stays one frame with a bad crc
+static void mcu_corrupt(uint8_t *frame, uint16_t len) {
+  for (;;) {
+    uint16_t i = 1 + test_rand() % (len - 2);
+    uint8_t corrupted = frame[i] ^ (1 << (test_rand() % 8));
+    if (frame[i] != 0x7d && frame[i] != 0x7e && frame[i - 1] != 0x7d &&
+        corrupted != 0x7d && corrupted != 0x7e) {
+      frame[i] = corrupted;
+      return;
+    }
+  }
+}
+
+// Sends one frame, intact or not. Returns whether it was BLE data that
+// arrives.
+static bool mcu_send(uint32_t n) {
+  static uint8_t payload[128];
+  static uint8_t frame[SERIAL_LINK_FRAME_LEN_MAX(sizeof(payload))];
+  uint16_t len;
+  bool arrives = false;
+  uint32_t kind = test_rand() % 10;
+  switch (kind) {
+  case 0:
+    // Longer than UART_RX_PAYLOAD_MAX
+    test_rand_fill(payload, sizeof(payload));
+    len = serial_link_format(frame, sizeof(frame), SL_PT_CTRL_DATA, payload,
+                             sizeof(payload));
+    break;
+  case 1:
+    // Unknown type
+    len = serial_link_format(frame, sizeof(frame), 0xc3, payload, 4);
+    break;
+  case 2:
+    len = serial_link_format(frame, sizeof(frame), SL_PT_CTRL_DATA, NULL, 0);
+    break;
+  case 3:
+    // Power level 0 is ignored
+    payload[0] = SL_CTRL_CMD_BLE_PWR_LEVEL;
+    payload[1] = 0;
+    len = serial_link_format(frame, sizeof(frame), SL_PT_CTRL_DATA, payload, 2);
+    break;
+  default:
+    payload[0] = n & 0xff;
+    payload[1] = (n >> 8) & 0xff;
+    payload[2] = n >> 16;
+    for (int i = 3; i < UART_BLE_PACKET_LEN; i++) {
+      payload[i] = n + i;
+    }
+    len = serial_link_format(frame, sizeof(frame), SL_PT_BLE_DATA, payload,
+                             UART_BLE_PACKET_LEN);
+    arrives = kind > 5;
+    if (!arrives) {
+      mcu_corrupt(frame, len);
+    }
+    break;
+  }
+  sim_rx(frame, len, 16);
+  mcu_sent++;
+  return arrives;
+}
+
+int main(void) {
+  sl_peer_caps.version = 2;
+  sl_parser_init(&mcu_parser, mcu_frame, sizeof(mcu_frame), NULL);
+  uart_task_init();
+  uart_task_enable();
+
+  uint32_t sent = 0;
+  uint32_t arriving = 0;
+  uint32_t stalled = 0;
+  while (sent < FRAMES) {
+    sim_run();
+    mcu_receive();
+    if (mcu_granted && (int16_t)(mcu_limit - mcu_sent) > 0) {
+      arriving += mcu_send(sent++);
+      stalled = 0;
+    } else {
+      CHECK(++stalled < STALL_MAX);
+    }
+    sim_tick();
+  }
+  do {
+    mcu_receive();
+  } while (sim_run() > 0);
+
+  CHECK(app_ble_frames == arriving);
+  // Everything was consumed, so all credits are back
+  CHECK((int16_t)(mcu_limit - mcu_sent) >= UART_RX_CREDITS / 2);
+  CHECK(uart_rx_stats.frames > 0);
+  CHECK(sim_live_msgs == 0);
+  return 0;
+}
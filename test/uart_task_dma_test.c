@@ -0,0 +1,148 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Sends BLE data to uart_task.c with the RX DMA, from an MCU that keeps to its
+// credits. The interrupt of the FIFO comes before the DMA took the last byte,
+// every frame still has to be dispatched once the line goes idle. Bursts of
+// all credits wrap the DMA buffer. With the argument "heap_full" there is no
+// room for the buffer and RX stays with the interrupt.
+
+#include <custs1_task.h>
+#include <string.h>
+
+#include "sdk_sim.h"
+#include "serial_link.h"
+#include "test.h"
+#include "uart_task.h"
+
+#define FRAMES 3000
+// Iterations the MCU may wait for a credit
+#define STALL_MAX 100
+
+// MCU side
+static struct sl_parser mcu_parser;
+static uint8_t mcu_frame[512];
+static uint16_t mcu_limit = 0;
+static bool mcu_granted = false;
+static uint16_t mcu_sent = 0;
+// Bytes sent, and pieces the FIFO got them in
+static uint32_t mcu_bytes = 0;
+static uint32_t mcu_pieces = 0;
+
+// BLE data the chip indicated
+static uint32_t app_ble_frames = 0;
+
+void sim_app_msg(ke_msg_id_t id, void *param) {
+  CHECK(id == CUSTS1_VAL_IND_REQ);
+  struct custs1_val_ind_req *req = param;
+  CHECK(req->length == UART_BLE_PACKET_LEN);
+  uint32_t n = req->value[0] | req->value[1] << 8 | req->value[2] << 16;
+  CHECK(n == app_ble_frames);
+  for (int i = 3; i < UART_BLE_PACKET_LEN; i++) {
+    CHECK(req->value[i] == (uint8_t)(n + i));
+  }
+  app_ble_frames++;
+  uart_task_ble_confirmed();
+}
+
+// Reads what the chip sent and takes the credits it granted
+static void mcu_receive(void) {
+  static uint8_t buf[1024];
+  static uint16_t buf_len = 0;
+  uint16_t len;
+  while ((len = sim_tx_complete(&buf[buf_len], sizeof(buf) - buf_len)) > 0) {
+    CHECK(len <= sizeof(buf) - buf_len);
+    buf_len += len;
+    for (;;) {
+      enum sl_status res =
+          serial_link_parse_packet(&mcu_parser, buf, &buf_len);
+      if (res == SL_NONE) {
+        break;
+      }
+      CHECK(res != SL_ERR);
+      const uint8_t *payload = sl_parser_payload(&mcu_parser);
+      if (res == SL_PACKET_TYPE_CTRL_DATA &&
+          payload[0] == SL_CTRL_CMD_CREDIT) {
+        mcu_limit = payload[1] | payload[2] << 8;
+        mcu_granted = true;
+      }
+    }
+  }
+}
+
+static bool mcu_credit(void) {
+  return mcu_granted && (int16_t)(mcu_limit - mcu_sent) > 0;
+}
+
+static void mcu_send(uint32_t n) {
+  uint8_t payload[UART_BLE_PACKET_LEN];
+  uint8_t frame[SERIAL_LINK_FRAME_LEN_MAX(sizeof(payload))];
+  payload[0] = n & 0xff;
+  payload[1] = (n >> 8) & 0xff;
+  payload[2] = n >> 16;
+  for (int i = 3; i < UART_BLE_PACKET_LEN; i++) {
+    payload[i] = n + i;
+  }
+  uint16_t len = serial_link_format(frame, sizeof(frame), SL_PT_BLE_DATA,
+                                    payload, sizeof(payload));
+  uint16_t fifo = 1 + test_rand() % 16;
+  sim_rx(frame, len, fifo);
+  mcu_sent++;
+  mcu_bytes += len;
+  mcu_pieces += (len + fifo - 1) / fifo;
+}
+
+int main(int argc, char **argv) {
+  sim_heap_full = argc > 1 && strcmp(argv[1], "heap_full") == 0;
+  sl_peer_caps.version = 2;
+  sl_parser_init(&mcu_parser, mcu_frame, sizeof(mcu_frame), NULL);
+  uart_task_init();
+  uart_task_enable();
+
+  uint32_t sent = 0;
+  uint32_t stalled = 0;
+  while (sent < FRAMES) {
+    sim_run();
+    mcu_receive();
+    if (!mcu_credit()) {
+      CHECK(++stalled < STALL_MAX);
+      sim_tick();
+      continue;
+    }
+    stalled = 0;
+    // One frame and then the line is idle, or a burst of all credits
+    bool burst = test_rand() % 4 == 0;
+    do {
+      mcu_send(sent++);
+    } while (burst && sent < FRAMES && mcu_credit());
+    sim_run();
+    CHECK(app_ble_frames == sent);
+    sim_tick();
+  }
+  do {
+    mcu_receive();
+  } while (sim_run() > 0);
+
+  CHECK(app_ble_frames == FRAMES);
+  CHECK(uart_rx_stats.overruns == 0);
+  if (!sim_heap_full) {
+    // At most one interrupt of the FIFO per UART_RX_DRAIN, and those of the
+    // DMA
+    CHECK(uart_rx_stats.irqs <=
+          FRAMES + mcu_bytes / (UART_RX_DMA_LEN / 2) + 1);
+    CHECK(uart_rx_stats.irqs < mcu_pieces / 2);
+  }
+  CHECK(sim_live_msgs == 0);
+  return 0;
+}
@@ -0,0 +1,153 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Queues a pairing code behind a backlog of BLE data, once right after the
+// first message and once with the UART saturated. The code overtakes the
+// backlog: before it the MCU only gets the transfer that was being sent, which
+// is the first message in the first case. Every transfer takes a tick, so that
+// lane_delay tells the lanes apart.
+
+#include <string.h>
+
+#include "sdk_sim.h"
+#include "serial_link.h"
+#include "test.h"
+#include "uart_task.h"
+
+#define BACKLOG 40
+// sim_tick() in units of lld_evt_time_get()
+#define TICK_US (16 * UART_TIME_RESOLUTION_US)
+
+static struct sl_parser mcu_parser;
+static uint8_t mcu_frame[256];
+// Bytes received by the MCU, and how many of them came before the pairing code
+static uint32_t mcu_bytes = 0;
+static uint32_t mcu_code_at = 0;
+static bool mcu_code = false;
+static uint32_t mcu_ble = 0;
+
+void sim_app_msg(ke_msg_id_t id, void *param) {}
+
+// Ends the transfer being sent, if any, and parses it. Returns its length.
+static uint16_t mcu_complete(void) {
+  static uint8_t buf[1024];
+  static uint16_t buf_len = 0;
+  uint16_t len = sim_tx_complete(&buf[buf_len], sizeof(buf) - buf_len);
+  if (len == 0) {
+    return 0;
+  }
+  CHECK(len <= sizeof(buf) - buf_len);
+  buf_len += len;
+  for (;;) {
+    uint32_t frame_at = mcu_bytes;
+    uint16_t before = buf_len;
+    enum sl_status res = serial_link_parse_packet(&mcu_parser, buf, &buf_len);
+    mcu_bytes += before - buf_len;
+    if (res == SL_NONE) {
+      break;
+    }
+    if (res == SL_PACKET_TYPE_BLE_DATA) {
+      mcu_ble++;
+    } else {
+      CHECK(res == SL_PACKET_TYPE_CTRL_DATA &&
+            sl_parser_payload(&mcu_parser)[0] == SL_CTRL_CMD_PAIRING_CODE);
+      mcu_code_at = frame_at;
+      mcu_code = true;
+    }
+  }
+  return len;
+}
+
+static void chip_send(uint8_t type, const uint8_t *value, uint16_t len) {
+  struct uart_tx_req *req =
+      KE_MSG_ALLOC_DYN(UART_TX, TASK_UART, TASK_APP, uart_tx_req, len);
+  req->type = type;
+  req->length = len;
+  memcpy(req->value, value, len);
+  KE_MSG_SEND(req);
+}
+
+static const uint8_t ble[UART_BLE_PACKET_LEN] = {0x42};
+
+static void chip_send_backlog(void) {
+  for (int i = 0; i < BACKLOG; i++) {
+    chip_send(SL_PT_BLE_DATA, ble, sizeof(ble));
+  }
+}
+
+// Queues the pairing code and checks that the MCU gets it right after the
+// transfer that is being sent. With UART_TX_STREAM that is a chunk, and the
+// TX interrupt finishes the frame it ends in. Returns the bytes the MCU got
+// before the code.
+static uint32_t pairing_code(uint16_t ble_frame_len) {
+  const uint8_t code[] = {SL_CTRL_CMD_PAIRING_CODE, 1, 2, 3, 4, 5, 6};
+  uint32_t bytes = mcu_bytes;
+  mcu_code = false;
+  chip_send(SL_PT_CTRL_DATA, code, sizeof(code));
+  sim_run();
+  uint16_t sending = 0;
+  while (!mcu_code) {
+    sim_tick();
+    uint16_t len = mcu_complete();
+    CHECK(len > 0);
+    sending = sending > 0 ? sending : len;
+    sim_run();
+  }
+  uint32_t ahead = mcu_code_at - bytes;
+#if UART_TX_STREAM
+  CHECK(ahead <= sending + ble_frame_len);
+#else
+  CHECK(ahead <= sending);
+#endif
+  return ahead;
+}
+
+static void drain(void) {
+  do {
+    sim_tick();
+  } while (mcu_complete() || sim_run() > 0);
+}
+
+int main(void) {
+  sl_parser_init(&mcu_parser, mcu_frame, sizeof(mcu_frame), NULL);
+  uart_task_init();
+  uart_task_enable();
+  sim_run();
+
+  // At most the first message is sent before the code
+  uint8_t frame[SERIAL_LINK_FRAME_LEN_MAX(sizeof(ble))];
+  uint16_t ble_frame_len = serial_link_format(frame, sizeof(frame),
+                                              SL_PT_BLE_DATA, ble, sizeof(ble));
+  chip_send_backlog();
+  CHECK(pairing_code(ble_frame_len) <= ble_frame_len);
+  drain();
+
+  chip_send_backlog();
+  sim_run();
+  for (int i = 0; i < 3; i++) {
+    sim_tick();
+    CHECK(mcu_complete() > 0);
+    sim_run();
+  }
+  pairing_code(ble_frame_len);
+  drain();
+
+  CHECK(mcu_ble == 2 * BACKLOG);
+  // The code waited for at most two transfers, the backlog for several
+  CHECK(uart_tx_stats.lane_delay[UART_TX_LANE_CTRL].count == 2);
+  CHECK(uart_tx_stats.lane_delay[UART_TX_LANE_CTRL].max <= 2 * TICK_US);
+  CHECK(uart_tx_stats.lane_delay[UART_TX_LANE_BULK].max > 4 * TICK_US);
+  CHECK(sim_live_msgs == 0);
+  return 0;
+}
@@ -0,0 +1,413 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Runs the link layer of uart_task.c against an MCU that keeps its own
+// sl_link. Both sides send numbered messages while the given percentage of
+// frames is corrupted in both directions and of standalone ACKs is lost:
+//   ./uart_task_link_test <percent>
+// Every message has to arrive exactly once and in order, across several
+// wraps of the sequence numbers.
+
+#include <custs1_task.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdk_sim.h"
+#include "serial_link.h"
+#include "sl_link.h"
+#include "test.h"
+#include "uart_task.h"
+
+#define MESSAGES 1200
+// Control messages this test sends start with this, the chip sends others
+#define CTRL_CMD_TEST 0xf0
+// Messages the chip may have queued and not yet delivered
+#define CHIP_QUEUE_MAX 16
+#define ITERATIONS_MAX 100000
+
+static uint32_t corrupt_percent = 0;
+
+// MCU side
+static struct sl_parser mcu_parser;
+static uint8_t mcu_frame[512];
+static struct sl_link mcu_link;
+// Number of the BLE data in each slot of the window
+static uint32_t mcu_tx_window[SL_LINK_WINDOW_MAX];
+static uint32_t mcu_ble_next = 0;
+// When the oldest frame in flight was last acknowledged or sent again
+static uint32_t mcu_progress = 0;
+// Frames received ahead of a missing one, by slot
+static struct {
+  bool held;
+  uint8_t payload[64];
+  uint16_t len;
+} mcu_rx_window[SL_LINK_WINDOW_MAX];
+// Next control message of the chip
+static uint32_t mcu_ctrl_next = 0;
+static uint8_t mcu_window_reply = 0;
+// The last transfer of the chip was a NAK, and what it asked for
+static bool mcu_got_nak = false;
+static uint8_t mcu_nak_ack = 0;
+// Data frames of the chip received, and the sequence number of the last one
+static uint32_t mcu_data_frames = 0;
+static uint8_t mcu_data_seq = 0;
+// The data frame of the chip with this sequence number is lost once
+static int mcu_lose_seq = -1;
+
+// Next control message the chip is given to send
+static uint32_t chip_ctrl_next = 0;
+
+// BLE data the chip indicated
+static uint32_t app_ble_next = 0;
+
+void sim_app_msg(ke_msg_id_t id, void *param) {
+  CHECK(id == CUSTS1_VAL_IND_REQ);
+  struct custs1_val_ind_req *req = param;
+  CHECK(req->length == UART_BLE_PACKET_LEN);
+  uint32_t n = req->value[0] | req->value[1] << 8;
+  CHECK(n == (app_ble_next & 0xffff));
+  for (int i = 2; i < UART_BLE_PACKET_LEN; i++) {
+    CHECK(req->value[i] == (uint8_t)(n * 3 + i));
+  }
+  app_ble_next++;
+  uart_task_ble_confirmed();
+}
+
+static bool percent(uint32_t p) { return test_rand() % 100 < p; }
+
+// Flips a bit of a byte that is neither SOF nor ESCAPE nor escaped, and doesn't
+// become one of them, so that the frames stay delimited and a crc fails
+static void corrupt(uint8_t *data, uint16_t len) {
+  if (len < 4) {
+    return;
+  }
+  for (int tries = 0; tries < 100; tries++) {
+    uint16_t i = 1 + test_rand() % (len - 2);
+    uint8_t corrupted = data[i] ^ (1 << (test_rand() % 8));
+    if (data[i] != 0x7d && data[i] != 0x7e && data[i - 1] != 0x7d &&
+        corrupted != 0x7d && corrupted != 0x7e) {
+      data[i] = corrupted;
+      return;
+    }
+  }
+}
+
+static void mcu_ble_fill(uint8_t *payload, uint32_t n) {
+  payload[0] = n & 0xff;
+  payload[1] = (n >> 8) & 0xff;
+  for (int i = 2; i < UART_BLE_PACKET_LEN; i++) {
+    payload[i] = n * 3 + i;
+  }
+}
+
+// Sends a sequenced frame to the chip, possibly corrupted, or lost if it is a
+// standalone ACK
+static void mcu_send(uint8_t type, uint8_t seq, uint8_t ack,
+                     const uint8_t *payload, uint16_t len) {
+  uint8_t frame[SERIAL_LINK_FRAME_LEN_MAX(UART_BLE_PACKET_LEN)];
+  struct sl_iov iov = {payload, len};
+  uint16_t frame_len = serial_link_format_seq(frame, sizeof(frame), type, seq,
+                                              ack, &iov, payload ? 1 : 0);
+  if (percent(corrupt_percent)) {
+    if (type == SL_PT_ACK) {
+      return;
+    }
+    corrupt(frame, frame_len);
+  }
+  sim_rx(frame, frame_len, 16);
+}
+
+static void mcu_send_ble(uint8_t seq) {
+  uint8_t payload[UART_BLE_PACKET_LEN];
+  mcu_ble_fill(payload, mcu_tx_window[sl_link_slot(seq)]);
+  mcu_send(SL_PT_BLE_DATA, seq, mcu_link.rx_expected, payload,
+           sizeof(payload));
+  mcu_link.ack_pending = false;
+}
+
+// Sends what is due, like uart_task_link_kick, and goes back the whole window
+// when nothing has been acknowledged for a while
+static void mcu_link_kick(void) {
+  if (sl_link_in_flight(&mcu_link) > 0 &&
+      sim_now - mcu_progress >= UART_LINK_TIMEOUT_TICKS) {
+    sl_link_tx_resend_all(&mcu_link);
+    mcu_progress = sim_now;
+  }
+  if (mcu_link.nak_pending) {
+    mcu_send(SL_PT_NAK, mcu_link.tx_sent, mcu_link.rx_expected, NULL, 0);
+    mcu_link.nak_pending = false;
+    mcu_link.ack_pending = false;
+  }
+  uint8_t seq;
+  while (sl_link_tx_resend_next(&mcu_link, &seq)) {
+    mcu_send_ble(seq);
+  }
+  while (sl_link_tx_ready(&mcu_link) && mcu_ble_next < MESSAGES) {
+    if (sl_link_in_flight(&mcu_link) == 0) {
+      mcu_progress = sim_now;
+    }
+    mcu_tx_window[sl_link_slot(sl_link_tx_push(&mcu_link))] = mcu_ble_next++;
+    mcu_send_ble(sl_link_tx_next(&mcu_link));
+  }
+  if (mcu_link.ack_pending) {
+    mcu_send(SL_PT_ACK, mcu_link.tx_sent, mcu_link.rx_expected, NULL, 0);
+    mcu_link.ack_pending = false;
+  }
+}
+
+static void mcu_deliver(const uint8_t *payload, uint16_t len) {
+  if (len == 2 && payload[0] == SL_CTRL_CMD_LINK_WINDOW) {
+    mcu_window_reply = payload[1];
+    return;
+  }
+  CHECK(len >= 3 && payload[0] == CTRL_CMD_TEST);
+  uint32_t n = payload[1] | payload[2] << 8;
+  CHECK(n == (mcu_ctrl_next & 0xffff));
+  CHECK(len == 3 + n % 40);
+  for (uint16_t i = 3; i < len; i++) {
+    CHECK(payload[i] == (uint8_t)(n * 5 + i));
+  }
+  mcu_ctrl_next++;
+}
+
+static void mcu_frame_received(enum sl_status res) {
+  mcu_got_nak = false;
+  if (res == SL_ERR) {
+    sl_link_rx_error(&mcu_link);
+    return;
+  }
+  uint8_t type = sl_parser_type(&mcu_parser);
+  CHECK(sl_packet_type_is_seq(type));
+  uint8_t ack = sl_parser_ack(&mcu_parser);
+  if (type == SL_PT_NAK) {
+    mcu_got_nak = true;
+    mcu_nak_ack = ack;
+    sl_link_tx_nak(&mcu_link, ack);
+    return;
+  }
+  uint8_t seq = sl_parser_seq(&mcu_parser);
+  if (type != SL_PT_ACK && seq == mcu_lose_seq) {
+    mcu_lose_seq = -1;
+    return;
+  }
+  if (sl_link_tx_ack(&mcu_link, ack) > 0) {
+    mcu_progress = sim_now;
+  }
+  if (type == SL_PT_ACK) {
+    return;
+  }
+  CHECK(res == SL_PACKET_TYPE_CTRL_DATA);
+  const uint8_t *payload = sl_parser_payload(&mcu_parser);
+  uint16_t len = sl_parser_payload_len(&mcu_parser);
+  mcu_data_frames++;
+  mcu_data_seq = seq;
+  switch (sl_link_rx_seq(&mcu_link, seq)) {
+  case SL_LINK_RX_ACCEPT:
+    mcu_deliver(payload, len);
+    for (;;) {
+      uint8_t slot = sl_link_slot(mcu_link.rx_expected);
+      if (!mcu_rx_window[slot].held) {
+        break;
+      }
+      mcu_rx_window[slot].held = false;
+      mcu_deliver(mcu_rx_window[slot].payload, mcu_rx_window[slot].len);
+      sl_link_rx_advance(&mcu_link);
+    }
+    for (uint8_t i = 0; i < SL_LINK_WINDOW_MAX; i++) {
+      if (mcu_rx_window[i].held) {
+        sl_link_rx_error(&mcu_link);
+        break;
+      }
+    }
+    break;
+  case SL_LINK_RX_AHEAD: {
+    uint8_t slot = sl_link_slot(seq);
+    CHECK(len <= sizeof(mcu_rx_window[slot].payload));
+    memcpy(mcu_rx_window[slot].payload, payload, len);
+    mcu_rx_window[slot].len = len;
+    mcu_rx_window[slot].held = true;
+  } break;
+  default:
+    break;
+  }
+}
+
+// Ends the transfers of the chip and parses them, corrupting some and losing
+// some standalone ACKs. Returns the number of transfers.
+static int mcu_receive(void) {
+  static uint8_t buf[1024];
+  static uint16_t buf_len = 0;
+  int transfers = 0;
+  uint16_t len;
+  while ((len = sim_tx_complete(&buf[buf_len], sizeof(buf) - buf_len)) > 0) {
+    CHECK(len <= sizeof(buf) - buf_len);
+    transfers++;
+    if (percent(corrupt_percent)) {
+      if (len <= SERIAL_LINK_FRAME_LEN_MAX(0) &&
+          buf[buf_len + 1] == SL_PT_ACK) {
+        continue;
+      }
+      corrupt(&buf[buf_len], len);
+    }
+    buf_len += len;
+    enum sl_status res;
+    while ((res = serial_link_parse_packet(&mcu_parser, buf, &buf_len)) !=
+           SL_NONE) {
+      mcu_frame_received(res);
+    }
+  }
+  return transfers;
+}
+
+static void chip_send(void) {
+  uint32_t n = chip_ctrl_next++;
+  uint16_t len = 3 + n % 40;
+  struct uart_tx_req *req =
+      KE_MSG_ALLOC_DYN(UART_TX, TASK_UART, TASK_APP, uart_tx_req, len);
+  req->type = SL_PT_CTRL_DATA;
+  req->length = len;
+  req->value[0] = CTRL_CMD_TEST;
+  req->value[1] = n & 0xff;
+  req->value[2] = (n >> 8) & 0xff;
+  for (uint16_t i = 3; i < len; i++) {
+    req->value[i] = n * 5 + i;
+  }
+  KE_MSG_SEND(req);
+}
+
+static void enable_link(void) {
+  uint8_t payload[] = {SL_CTRL_CMD_LINK_WINDOW, SL_LINK_WINDOW_MAX};
+  uint8_t frame[SERIAL_LINK_FRAME_LEN_MAX(sizeof(payload))];
+  uint16_t len = serial_link_format(frame, sizeof(frame), SL_PT_CTRL_DATA,
+                                    payload, sizeof(payload));
+  sl_link_init(&mcu_link, SL_LINK_WINDOW_MAX);
+  sim_rx(frame, len, 16);
+  sim_run();
+  mcu_receive();
+  CHECK(mcu_window_reply == SL_LINK_WINDOW_MAX);
+  CHECK(mcu_link.rx_expected == 1);
+}
+
+// A NAK for a frame that was never sent acknowledges nothing and makes the
+// chip send nothing again
+static void nak_unsent(void) {
+  uint8_t unsent = mcu_link.rx_expected + SL_LINK_WINDOW_MAX;
+  uint32_t naks = uart_link_stats.naks;
+  mcu_send(SL_PT_NAK, mcu_link.tx_sent, unsent, NULL, 0);
+  sim_run();
+  CHECK(mcu_receive() == 0);
+  CHECK(uart_link_stats.naks == naks + 1);
+  CHECK(uart_link_stats.retransmits == 0);
+}
+
+// A sequenced frame whose header announces more than UART_RX_PAYLOAD_MAX bytes
+// is dropped before its payload and NAKed right away
+static void oversize_nak(void) {
+  uint8_t payload[UART_RX_PAYLOAD_MAX + 1] = {0};
+  uint8_t frame[SERIAL_LINK_FRAME_LEN_MAX(sizeof(payload))];
+  struct sl_iov iov = {payload, sizeof(payload)};
+  uint16_t len = serial_link_format_seq(frame, sizeof(frame),
+                                        SL_PT_CTRL_DATA, mcu_link.tx_sent,
+                                        mcu_link.rx_expected, &iov, 1);
+  sim_rx(frame, len, 16);
+  sim_run();
+  CHECK(mcu_receive() == 1);
+  CHECK(mcu_got_nak && mcu_nak_ack == mcu_link.tx_sent);
+}
+
+// The MCU loses the middle one of three frames and NAKs it once it has the
+// third. The chip sends that frame again and no other.
+static void selective_resend(void) {
+  uint32_t naks = uart_link_stats.naks;
+  uint32_t retransmits = uart_link_stats.retransmits;
+  uint32_t delivered = mcu_ctrl_next;
+  uint8_t lost = mcu_link.rx_expected + 1;
+  mcu_lose_seq = lost;
+  uint32_t frames = mcu_data_frames;
+  for (int i = 0; i < 3; i++) {
+    chip_send();
+  }
+  for (int i = 0; i < 3 && mcu_data_frames - frames < 2; i++) {
+    sim_run();
+    mcu_receive();
+  }
+  CHECK(mcu_data_frames - frames == 2);
+  CHECK(mcu_ctrl_next == delivered + 1);
+  CHECK(mcu_link.nak_pending && mcu_link.rx_expected == lost);
+
+  frames = mcu_data_frames;
+  mcu_send(SL_PT_NAK, mcu_link.tx_sent, mcu_link.rx_expected, NULL, 0);
+  mcu_link.nak_pending = false;
+  for (int i = 0; i < 3; i++) {
+    sim_run();
+    mcu_receive();
+  }
+  CHECK(mcu_data_frames - frames == 1 && mcu_data_seq == lost);
+  CHECK(mcu_ctrl_next == delivered + 3);
+  CHECK(uart_link_stats.naks == naks + 1);
+  CHECK(uart_link_stats.retransmits == retransmits + 1);
+}
+
+int main(int argc, char **argv) {
+  CHECK(argc == 2);
+  corrupt_percent = strtoul(argv[1], NULL, 0);
+  sl_parser_init(&mcu_parser, mcu_frame, sizeof(mcu_frame), NULL);
+  uart_task_init();
+  uart_task_enable();
+  sim_run();
+
+  enable_link();
+  uint32_t corrupt_later = corrupt_percent;
+  corrupt_percent = 0;
+  nak_unsent();
+  oversize_nak();
+  selective_resend();
+  corrupt_percent = corrupt_later;
+
+  for (uint32_t i = 0; app_ble_next < MESSAGES || mcu_ctrl_next < MESSAGES;
+       i++) {
+    CHECK(i < ITERATIONS_MAX);
+    while (chip_ctrl_next < MESSAGES &&
+           chip_ctrl_next - mcu_ctrl_next < CHIP_QUEUE_MAX) {
+      chip_send();
+    }
+    sim_run();
+    mcu_receive();
+    mcu_link_kick();
+    sim_run();
+    mcu_receive();
+    sim_tick();
+  }
+
+  // Without errors both sides get their last frames acknowledged
+  corrupt_percent = 0;
+  for (int i = 0; i < 4 * UART_LINK_TIMEOUT_TICKS; i++) {
+    sim_run();
+    mcu_receive();
+    mcu_link_kick();
+    sim_tick();
+  }
+  sim_run();
+  mcu_receive();
+
+  CHECK(app_ble_next == MESSAGES);
+  CHECK(mcu_ctrl_next == MESSAGES);
+  CHECK(sl_link_in_flight(&mcu_link) == 0);
+  if (corrupt_later > 0) {
+    CHECK(uart_link_stats.naks > 1);
+    CHECK(uart_link_stats.retransmits > 0);
+  }
+  CHECK(sim_live_msgs == 0);
+  return 0;
+}
@@ -0,0 +1,77 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Runs uart_task.c out of message heap with an MCU that doesn't take credits.
+// TASK_UART leaves the RX ring alone until the heap has room again, then parses
+// what was in it without the MCU sending more.
+
+#include <custs1_task.h>
+#include <da1458x_scatter_config.h>
+#include <string.h>
+
+#include "sdk_sim.h"
+#include "serial_link.h"
+#include "test.h"
+#include "uart_task.h"
+
+// BLE data the chip indicated
+static uint32_t app_ble_frames = 0;
+
+void sim_app_msg(ke_msg_id_t id, void *param) {
+  CHECK(id == CUSTS1_VAL_IND_REQ);
+  struct custs1_val_ind_req *req = param;
+  CHECK(req->length == UART_BLE_PACKET_LEN);
+  CHECK(req->value[0] == app_ble_frames);
+  app_ble_frames++;
+  uart_task_ble_confirmed();
+}
+
+static void mcu_send(uint8_t n) {
+  uint8_t payload[UART_BLE_PACKET_LEN] = {n};
+  uint8_t frame[SERIAL_LINK_FRAME_LEN_MAX(sizeof(payload))];
+  uint16_t len = serial_link_format(frame, sizeof(frame), SL_PT_BLE_DATA,
+                                    payload, sizeof(payload));
+  sim_rx(frame, len, 16);
+}
+
+static void ticks(int n) {
+  for (int i = 0; i < n; i++) {
+    sim_tick();
+    sim_run();
+  }
+}
+
+int main(void) {
+  uart_task_init();
+  uart_task_enable();
+  sim_run();
+
+  // The heap stays full for a few rounds of turn_on_rx_cb
+  sim_mem_usage = __SCT_HEAP_MSG_SIZE;
+  mcu_send(0);
+  sim_run();
+  ticks(25);
+  CHECK(app_ble_frames == 0);
+
+  sim_mem_usage = 0;
+  ticks(10);
+  CHECK(app_ble_frames == 1);
+
+  // The RX interrupt is back on
+  mcu_send(1);
+  sim_run();
+  CHECK(app_ble_frames == 2);
+  CHECK(sim_live_msgs == 0);
+  return 0;
+}
@@ -0,0 +1,157 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Sends PINGs to uart_task.c while TASK_UART is held up, in pieces that arrive
+// at different times. The time a PING was received is that of the RX
+// interrupt that took its last byte, not that of TASK_UART parsing it, and the
+// queue delay counts the wait.
+//
+// Then answers the PINGs of the chip, with the clock of the MCU ahead or
+// behind and with a turnaround longer than the round trip the chip measures.
+
+#include <string.h>
+
+#include "sdk_sim.h"
+#include "serial_link.h"
+#include "test.h"
+#include "uart_task.h"
+#include "util.h"
+
+#define PINGS 1000
+// sim_tick() in units of lld_evt_time_get()
+#define TICK 16
+#define TICK_US (TICK * UART_TIME_RESOLUTION_US)
+
+static struct sl_parser mcu_parser;
+static uint8_t mcu_frame[64];
+
+void sim_app_msg(ke_msg_id_t id, void *param) {}
+
+// Returns the payload of the next PING of the chip. If `wait` the time goes on
+// until there is one.
+static const uint8_t *mcu_next_ping(bool wait) {
+  static uint8_t buf[256];
+  static uint16_t buf_len = 0;
+  for (;;) {
+    enum sl_status res = serial_link_parse_packet(&mcu_parser, buf, &buf_len);
+    if (res == SL_PACKET_TYPE_PING) {
+      return sl_parser_payload(&mcu_parser);
+    }
+    CHECK(res == SL_NONE);
+    uint16_t len = sim_tx_complete(&buf[buf_len], sizeof(buf) - buf_len);
+    CHECK(len <= sizeof(buf) - buf_len);
+    if (len == 0 && wait) {
+      sim_tick();
+      sim_run();
+      continue;
+    }
+    CHECK(len > 0);
+    buf_len += len;
+  }
+}
+
+// Reads the response to the PING with `id`, returns the time it was received
+// and sent on the chip. The PINGs of the chip aren't answered.
+static void mcu_response(uint8_t id, uint32_t *received, uint32_t *sent) {
+  const uint8_t *payload;
+  while ((payload = mcu_next_ping(false))[0] == SL_PING_REQUEST) {
+  }
+  CHECK(sl_parser_payload_len(&mcu_parser) == SL_PING_RESPONSE_LEN);
+  CHECK(payload[0] == SL_PING_RESPONSE && payload[1] == id);
+  *received = read_u32_le(&payload[6]);
+  *sent = read_u32_le(&payload[10]);
+}
+
+// Answers the next PING of the chip `delay` ticks after it was queued. The MCU
+// takes `turnaround` by its clock, which is `offset` ahead of that of the
+// chip, and the frames take equally long both ways.
+static void mcu_answer(uint32_t delay, uint32_t turnaround, int32_t offset) {
+  const uint8_t *request = mcu_next_ping(true);
+  CHECK(sl_parser_payload_len(&mcu_parser) == SL_PING_REQUEST_LEN);
+  CHECK(request[0] == SL_PING_REQUEST);
+  uint8_t response[SL_PING_RESPONSE_LEN] = {SL_PING_RESPONSE, request[1]};
+  memcpy(&response[2], &request[2], 4);
+  uint32_t sent = read_u32_le(&request[2]);
+  int32_t one_way = ((int32_t)(delay * TICK_US) - (int32_t)turnaround) / 2;
+  uint32_t peer_received = sent + offset + one_way;
+  write_u32_le(&response[6], peer_received);
+  write_u32_le(&response[10], peer_received + turnaround);
+
+  for (uint32_t i = 0; i < delay; i++) {
+    sim_tick();
+  }
+  uint8_t frame[SERIAL_LINK_FRAME_LEN_MAX(sizeof(response))];
+  uint16_t len = serial_link_format(frame, sizeof(frame), SL_PT_PING,
+                                    response, sizeof(response));
+  sim_rx(frame, len, 16);
+  sim_run();
+}
+
+int main(void) {
+  sl_parser_init(&mcu_parser, mcu_frame, sizeof(mcu_frame), NULL);
+  // An MCU that answered the HELLO gets PINGs
+  sl_peer_caps.version = 1;
+  uart_task_init();
+  uart_task_enable();
+  sim_run();
+
+  uint32_t hold_max = 0;
+  for (uint32_t n = 0; n < PINGS; n++) {
+    uint8_t ping[SL_PING_REQUEST_LEN] = {SL_PING_REQUEST, n & 0xff};
+    uint8_t frame[SERIAL_LINK_FRAME_LEN_MAX(sizeof(ping))];
+    uint16_t len = serial_link_format(frame, sizeof(frame), SL_PT_PING, ping,
+                                      sizeof(ping));
+
+    // TASK_UART doesn't get to run while the pieces arrive, nor for a while
+    // after
+    uint16_t split = test_rand() % len;
+    sim_rx(frame, split, 4);
+    uint32_t gap = test_rand() % 3;
+    for (uint32_t i = 0; i < gap; i++) {
+      sim_tick();
+    }
+    sim_rx(&frame[split], len - split, 4);
+    uint32_t received_at = sim_now;
+    uint32_t hold = test_rand() % 5;
+    for (uint32_t i = 0; i < hold; i++) {
+      sim_tick();
+    }
+    hold_max = hold > hold_max ? hold : hold_max;
+    sim_run();
+
+    uint32_t received;
+    uint32_t sent;
+    mcu_response(ping[1], &received, &sent);
+    CHECK(received == received_at * TICK_US);
+    CHECK(sent == (received_at + hold) * TICK_US);
+    sim_run();
+  }
+
+  CHECK(uart_ping_stats.queue_delay.count == PINGS);
+  CHECK(uart_ping_stats.queue_delay.max == hold_max * TICK_US);
+
+  memset(&uart_ping_stats.rtt, 0, sizeof(uart_ping_stats.rtt));
+  mcu_answer(3, 10000, -123456);
+  CHECK(uart_ping_stats.rtt.count == 1);
+  CHECK(uart_ping_stats.rtt.max == 20000);
+  CHECK(uart_ping_stats.clock_offset == -123456);
+  // Longer than the round trip, the RTT counts as 0
+  mcu_answer(1, 14000, 5000000);
+  CHECK(uart_ping_stats.rtt.count == 2);
+  CHECK(uart_ping_stats.rtt.min == 0);
+  CHECK(uart_ping_stats.rtt.max == 20000);
+  CHECK(uart_ping_stats.clock_offset == 5000000);
+  CHECK(sim_live_msgs == 0);
+  return 0;
+}
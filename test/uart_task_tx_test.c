@@ -0,0 +1,159 @@
+// Copyright 2025 Shift Crypto AG
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Runs the TX path of uart_task.c without the link layer, with transfers that
+// end while TASK_UART formats the next one. The MCU copies a transfer when it
+// ends, so a frame written over one that is being sent shows up as a broken
+// frame. Without UART_TX_STREAM nothing is formatted with the interrupts
+// disabled.
+
+#include <string.h>
+
+#include "sdk_sim.h"
+#include "serial_link.h"
+#include "test.h"
+#include "uart_task.h"
+
+#define MESSAGES 5000
+// Control messages this test sends start with this, the chip sends others
+#define CTRL_CMD_TEST 0xf0
+
+// MCU side
+static struct sl_parser mcu_parser;
+static uint8_t mcu_frame[1024];
+static uint32_t mcu_ctrl_next = 0;
+static uint32_t mcu_ble_next = 0;
+
+void sim_app_msg(ke_msg_id_t id, void *param) {}
+
+// Numbers a payload, the rest of it follows from the number
+static void fill(uint8_t *data, uint16_t len, uint32_t n) {
+  data[0] = n & 0xff;
+  data[1] = (n >> 8) & 0xff;
+  for (uint16_t i = 2; i < len; i++) {
+    data[i] = n * 7 + i;
+  }
+}
+
+static uint32_t check_fill(const uint8_t *data, uint16_t len) {
+  uint32_t n = data[0] | data[1] << 8;
+  for (uint16_t i = 2; i < len; i++) {
+    CHECK(data[i] == (uint8_t)(n * 7 + i));
+  }
+  return n;
+}
+
+// Control messages are 3 to 300 bytes long, BLE data is split into frames of
+// UART_BLE_PACKET_LEN bytes that are numbered of their own
+static void mcu_frame_received(enum sl_status res) {
+  const uint8_t *payload = sl_parser_payload(&mcu_parser);
+  uint16_t len = sl_parser_payload_len(&mcu_parser);
+  if (res == SL_PACKET_TYPE_CTRL_DATA && payload[0] == CTRL_CMD_TEST) {
+    CHECK(len >= 3 && len == 3 + (payload[1] | payload[2] << 8) % 298);
+    CHECK(check_fill(&payload[1], len - 1) == (mcu_ctrl_next & 0xffff));
+    mcu_ctrl_next++;
+  } else if (res == SL_PACKET_TYPE_BLE_DATA) {
+    CHECK(len == UART_BLE_PACKET_LEN);
+    CHECK(check_fill(payload, len) == (mcu_ble_next & 0xffff));
+    mcu_ble_next++;
+  }
+}
+
+// Ends the transfer being sent, if any, and parses it
+static bool mcu_complete(void) {
+  static uint8_t buf[2048];
+  static uint16_t buf_len = 0;
+  uint16_t len = sim_tx_complete(&buf[buf_len], sizeof(buf) - buf_len);
+  if (len == 0) {
+    return false;
+  }
+  CHECK(len <= sizeof(buf) - buf_len);
+  buf_len += len;
+  for (;;) {
+    enum sl_status res = serial_link_parse_packet(&mcu_parser, buf, &buf_len);
+    if (res == SL_NONE) {
+      break;
+    }
+    CHECK(res != SL_ERR);
+    mcu_frame_received(res);
+  }
+  return true;
+}
+
+// The TX interrupt, at a random point of TASK_UART
+static void preempt(void) {
+  if (test_rand() % 3 == 0) {
+    mcu_complete();
+  }
+}
+
+static void chip_send(uint32_t *ctrl, uint32_t *ble) {
+  struct uart_tx_req *req;
+  if (test_rand() % 2 == 0) {
+    uint16_t len = 3 + *ctrl % 298;
+    req = KE_MSG_ALLOC_DYN(UART_TX, TASK_UART, TASK_APP, uart_tx_req, len);
+    req->type = SL_PT_CTRL_DATA;
+    req->length = len;
+    req->value[0] = CTRL_CMD_TEST;
+    // The length follows from the number
+    fill(&req->value[1], len - 1, (*ctrl)++);
+  } else {
+    uint16_t packets = 1 + test_rand() % 4;
+    req = KE_MSG_ALLOC_DYN(UART_TX, TASK_UART, TASK_APP, uart_tx_req,
+                           packets * UART_BLE_PACKET_LEN);
+    req->type = SL_PT_BLE_DATA;
+    req->length = packets * UART_BLE_PACKET_LEN;
+    for (uint16_t i = 0; i < req->length; i += UART_BLE_PACKET_LEN) {
+      fill(&req->value[i], UART_BLE_PACKET_LEN, (*ble)++);
+    }
+  }
+  KE_MSG_SEND(req);
+}
+
+int main(void) {
+  sl_parser_init(&mcu_parser, mcu_frame, sizeof(mcu_frame), NULL);
+  uart_task_init();
+  uart_task_enable();
+  sim_preempt = preempt;
+
+  uint32_t ctrl = 0;
+  uint32_t ble = 0;
+  uint32_t messages = 0;
+  while (messages < MESSAGES) {
+    uint32_t burst = 1 + test_rand() % 8;
+    for (uint32_t i = 0; i < burst; i++) {
+      chip_send(&ctrl, &ble);
+    }
+    messages += burst;
+    sim_run();
+    if (test_rand() % 2 == 0) {
+      mcu_complete();
+    }
+    sim_tick();
+  }
+  sim_preempt = NULL;
+  do {
+    while (mcu_complete()) {
+    }
+  } while (sim_run() > 0);
+
+  CHECK(mcu_ctrl_next == ctrl);
+  CHECK(mcu_ble_next == ble);
+  CHECK(uart_tx_stats.messages == messages);
+  CHECK(sim_live_msgs == 0);
+#if !UART_TX_STREAM
+  CHECK(sim_masked_frees == 0);
+#endif
+  return 0;
+}